@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+"""Writes a Func program with a generated call graph to standard output.
+
+    callgraph.py SHAPE N [--seed S]
+
+SHAPE is one of
+    chain    f0 calls f1 calls ... f(N-1); N groups of one function
+    cycle    one group: f(N-1) calls f0 back
+    cycles   groups of 8 mutually recursive functions, each group calling the next
+    random   every function calls 3 functions picked at random; mostly one big group
+    dag      every function calls 3 functions after it at random; N groups
+
+Identifiers may only contain letters, so function i is named f followed by i in base 26,
+written in capital letters to keep clear of the predefined functions.
+The programs are only meant to be compiled: running them never terminates.
+"""
+import argparse
+import random
+import sys
+
+
+def name(i):
+    digits = ""
+    while True:
+        digits = chr(ord("A") + i % 26) + digits
+        i //= 26
+        if i == 0:
+            return "f" + digits
+
+
+def callees(shape, n, i, rng):
+    if shape == "chain":
+        return [i + 1] if i + 1 < n else []
+    if shape == "cycle":
+        return [(i + 1) % n]
+    if shape == "cycles":
+        start = i - i % 8
+        end = min(start + 8, n)
+        result = [start + (i - start + 1) % (end - start)]
+        if i == start and end < n:
+            result.append(end)
+        return result
+    if shape == "random":
+        return [rng.randrange(n) for _ in range(3)]
+    if shape == "dag":
+        return [rng.randrange(i + 1, n) for _ in range(3)] if i + 1 < n else []
+    raise ValueError(shape)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("shape", choices=["chain", "cycle", "cycles", "random", "dag"])
+    parser.add_argument("n", type=int)
+    parser.add_argument("--seed", type=int, default=0)
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    out = sys.stdout
+    for i in range(args.n):
+        body = " + ".join(["x"] + ["%s x" % name(j) for j in callees(args.shape, args.n, i, rng)])
+        out.write("defn %s x = { %s }\n" % (name(i), body))
+    out.write("defn main = { %s 1 }\n" % name(0))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,64 @@
+/*
+    Times function_graph::compute_order on the call graph of a program written by
+    callgraph.py, without the rest of the compiler (or LLVM):
+
+        g++ -O2 -std=c++14 -I../src graph_bench.cpp ../src/graph.cpp -o graph_bench
+        ./callgraph.py random 100000 | ./graph_bench
+
+    Every definition gets an edge to each definition its body mentions, which is
+    the graph the type checker builds for these programs.
+*/
+#include "graph.hpp"
+#include <cctype>
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+int main() {
+    std::vector<std::pair<function, std::vector<function>>> definitions;
+    std::string line;
+    while(std::getline(std::cin, line)) {
+        std::istringstream words(line);
+        std::string keyword, name;
+        if(!(words >> keyword >> name) || keyword != "defn") continue;
+
+        std::vector<function> mentioned;
+        std::string body = line.substr(line.find('{'));
+        for(size_t i = 0; i < body.size();) {
+            if(!std::islower((unsigned char) body[i])) { i++; continue; }
+            size_t end = i;
+            while(end < body.size() && std::isalpha((unsigned char) body[end])) end++;
+            mentioned.push_back(body.substr(i, end - i));
+            i = end;
+        }
+        definitions.emplace_back(name, std::move(mentioned));
+    }
+
+    std::set<function> defined;
+    for(auto& definition : definitions) defined.insert(definition.first);
+
+    auto start = std::chrono::steady_clock::now();
+    function_graph graph;
+    size_t edges = 0;
+    for(auto& definition : definitions) {
+        graph.add_function(definition.first);
+        for(auto& callee : definition.second) {
+            if(!defined.count(callee)) continue;
+            graph.add_edge(definition.first, callee);
+            edges++;
+        }
+    }
+    auto built = std::chrono::steady_clock::now();
+    std::vector<group_ptr> groups = graph.compute_order();
+    auto done = std::chrono::steady_clock::now();
+
+    size_t largest = 0;
+    for(auto& g : groups) largest = std::max(largest, g->members.size());
+    std::chrono::duration<double> build_time = built - start, order_time = done - built;
+    std::cout << definitions.size() << " functions, " << edges << " edges, "
+        << groups.size() << " groups (largest " << largest << "): build "
+        << build_time.count() << "s, compute_order " << order_time.count() << "s" << std::endl;
+}
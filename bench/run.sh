@@ -0,0 +1,31 @@
+#!/bin/sh
+# Compiles generated call graphs of growing size with --time-report and prints
+# the phase times of each. Run ./build.sh first; extra arguments go to the compiler.
+#
+#     bench/run.sh [compiler options...]
+#
+# SHAPES and SIZES override what is generated, e.g. SIZES="1000 10000" bench/run.sh.
+
+SCRIPT_DIR=$(cd "$(dirname "$0")" && pwd)
+COMPILER="$SCRIPT_DIR/../build/compiler"
+SHAPES=${SHAPES:-"chain cycles random dag"}
+SIZES=${SIZES:-"1000 4000 16000 64000"}
+
+if [ ! -x "$COMPILER" ]; then
+    echo "Cannot find $COMPILER, run ./build.sh first." >&2
+    exit 1
+fi
+
+# The compiler writes program.o to the working directory.
+WORK_DIR=$(mktemp -d)
+trap 'rm -r "$WORK_DIR"' EXIT
+cd "$WORK_DIR" || exit 1
+
+for shape in $SHAPES; do
+    for size in $SIZES; do
+        echo "== $shape $size"
+        python3 "$SCRIPT_DIR/callgraph.py" "$shape" "$size" > program.func
+        "$COMPILER" --time-report "$@" < program.func 2>&1 >/dev/null |
+            grep -E '^(Phase|parse|typecheck|specialize|inline|compile|peephole|llvm|total) '
+    done
+done
@@ -9,6 +9,16 @@ static void print_indent(int n, std::ostream& to) {
     while(n--) to << "  ";
 }
 
+// Clones share the type environment of the original; they are only made after typechecking.
+static ast_ptr clone_env(const ast& from, ast* to) {
+    to->env = from.env;
+    return ast_ptr(to);
+}
+
+void ast::compile_tail(const tail_context& tail, const stack_env& env, std::vector<instruction_ptr>& into) const {
+    compile(env, into);
+}
+
 void ast_int::print(int indent, std::ostream& to) const {
     print_indent(indent, to);
     to << "INT: " << value << std::endl;
@@ -20,11 +30,20 @@ void ast_int::find_free(type_mgr& mgr, type_env_ptr& env, std::set<std::string>&
 
 type_ptr ast_int::typecheck(type_mgr& mgr) {
     // return type_ptr(new type_app(env->lookup_type("Int")));  // Do NOT use this
-    return type_ptr(new type_app(mgr.new_num_type()));  // An Int instance is num-taged-var type
+    num_type = mgr.new_app(mgr.new_num_type());  // An Int instance is num-taged-var type
+    return num_type;
 }
 
-void ast_int::compile(const env_ptr& env, std::vector<instruction_ptr>& into) const {
-    into.push_back(instruction_ptr(new instruction_pushint(value)));
+void ast_int::compile(const stack_env& env, std::vector<instruction_ptr>& into) const {
+    if(as_float) into.push_back(instruction_ptr(new instruction_pushfloat(value)));
+    else into.push_back(instruction_ptr(new instruction_pushint(value)));
+}
+
+ast_ptr ast_int::clone() const {
+    ast_int* new_int = new ast_int(value);
+    new_int->num_type = num_type;
+    new_int->as_float = as_float;
+    return clone_env(*this, new_int);
 }
 
 void ast_float::print(int indent, std::ostream& to) const {
@@ -37,13 +56,17 @@ void ast_float::find_free(type_mgr& mgr, type_env_ptr& env, std::set<std::string
 }
 
 type_ptr ast_float::typecheck(type_mgr& mgr) {
-    return type_ptr(new type_app(env->lookup_type("Float")));
+    return mgr.new_app(env->lookup_type("Float"));
 }
 
-void ast_float::compile(const env_ptr& env, std::vector<instruction_ptr>& into) const {
+void ast_float::compile(const stack_env& env, std::vector<instruction_ptr>& into) const {
     into.push_back(instruction_ptr(new instruction_pushfloat(value)));
 }
 
+ast_ptr ast_float::clone() const {
+    return clone_env(*this, new ast_float(value));
+}
+
 void ast_list::print(int indent, std::ostream& to) const {
     print_indent(indent, to);
     to << "LIST:" << std::endl;
@@ -59,16 +82,49 @@ type_ptr ast_list::typecheck(type_mgr& mgr) {
     type_ptr arg_type = mgr.new_type();
     for (auto &a : arr)
         mgr.unify(a->typecheck(mgr), arg_type);
-    type_ptr list_type = env->lookup_type("List");
-    type_app* list_app = new type_app(list_type);
-    list_app->arguments.emplace_back(arg_type);
-    type_ptr list_app_type = type_ptr(list_app);
-    return list_app_type;
+    return mgr.new_app(env->lookup_type("List"), { arg_type });
+}
+
+// Fills into if a is made only of number, character and list literals.
+static bool as_literal(const ast* a, literal& into) {
+    if(auto i = dynamic_cast<const ast_int*>(a)) {
+        into.kind = i->as_float ? literal::FLOAT : literal::INT;
+        into.int_value = i->value;
+        into.float_value = i->value;
+        return true;
+    } else if(auto f = dynamic_cast<const ast_float*>(a)) {
+        into.kind = literal::FLOAT;
+        into.float_value = f->value;
+        return true;
+    } else if(auto c = dynamic_cast<const ast_char*>(a)) {
+        into.kind = literal::CHAR;
+        into.char_value = c->value;
+        return true;
+    } else if(auto l = dynamic_cast<const ast_list*>(a)) {
+        if(dynamic_cast<const ast_list_colon*>(a)) return false;
+        type_data* list_type = static_cast<type_data*>(l->env->lookup_type("List").get());
+        into.kind = literal::LIST;
+        into.nil_tag = list_type->constructors.at("_Nil").tag;
+        into.cons_tag = list_type->constructors.at("_Cons").tag;
+        for(auto& element : l->arr) {
+            into.elements.emplace_back();
+            if(!as_literal(element.get(), into.elements.back())) return false;
+        }
+        return true;
+    }
+    return false;
 }
 
-void ast_list::compile(const env_ptr& env, std::vector<instruction_ptr>& into) const {
+void ast_list::compile(const stack_env& env, std::vector<instruction_ptr>& into) const {
+    // Constant lists (string literals in particular) are emitted once as static data.
+    literal value;
+    if(!arr.empty() && as_literal(this, value)) {
+        into.push_back(instruction_ptr(new instruction_pushliteral(std::move(value))));
+        return;
+    }
+
     into.push_back(instruction_ptr(new instruction_pushglobal("_Nil")));
-    env_ptr new_env = env_ptr(new env_offset(1, env));
+    stack_env new_env = env.offset(1);
     for (auto rit = arr.rbegin(); rit != arr.rend(); ++rit) {
         (*rit)->compile(new_env, into);
         into.push_back(instruction_ptr(new instruction_pushglobal("_Cons")));
@@ -77,21 +133,24 @@ void ast_list::compile(const env_ptr& env, std::vector<instruction_ptr>& into) c
     }
 }
 
+ast_ptr ast_list::clone() const {
+    std::vector<ast_ptr> new_arr;
+    for (auto &a : arr) new_arr.push_back(a->clone());
+    return clone_env(*this, new ast_list(std::move(new_arr)));
+}
+
 type_ptr ast_list_colon::typecheck(type_mgr& mgr) {
     type_ptr arg_type = mgr.new_type();
     for (auto it = arr.begin(); it != arr.end() - 1; it++)
         mgr.unify((*it)->typecheck(mgr), arg_type);
-    type_ptr list_type = env->lookup_type("List");
-    type_app* list_app = new type_app(list_type);
-    list_app->arguments.emplace_back(arg_type);
-    type_ptr list_app_type = type_ptr(list_app);
+    type_ptr list_app_type = mgr.new_app(env->lookup_type("List"), { arg_type });
     mgr.unify(list_app_type, arr.back()->typecheck(mgr));
     return list_app_type;
 }
 
-void ast_list_colon::compile(const env_ptr& env, std::vector<instruction_ptr>& into) const {
+void ast_list_colon::compile(const stack_env& env, std::vector<instruction_ptr>& into) const {
     arr.back()->compile(env, into);
-    env_ptr new_env = env_ptr(new env_offset(1, env));
+    stack_env new_env = env.offset(1);
     for (auto rit = arr.rbegin() + 1; rit != arr.rend(); ++rit) {
         (*rit)->compile(new_env, into);
         into.push_back(instruction_ptr(new instruction_pushglobal("_Cons")));
@@ -100,6 +159,12 @@ void ast_list_colon::compile(const env_ptr& env, std::vector<instruction_ptr>& i
     }
 }
 
+ast_ptr ast_list_colon::clone() const {
+    std::vector<ast_ptr> new_arr;
+    for (auto &a : arr) new_arr.push_back(a->clone());
+    return clone_env(*this, new ast_list_colon(std::move(new_arr)));
+}
+
 void ast_char::print(int indent, std::ostream& to) const {
     print_indent(indent, to);
     char unParsedChar = '\0';
@@ -118,13 +183,17 @@ void ast_char::find_free(type_mgr& mgr, type_env_ptr& env, std::set<std::string>
 }
 
 type_ptr ast_char::typecheck(type_mgr& mgr) {
-    return type_ptr(new type_app(env->lookup_type("Char")));
+    return mgr.new_app(env->lookup_type("Char"));
 }
 
-void ast_char::compile(const env_ptr& env, std::vector<instruction_ptr>& into) const {
+void ast_char::compile(const stack_env& env, std::vector<instruction_ptr>& into) const {
     into.push_back(instruction_ptr(new instruction_pushchar(value)));
 }
 
+ast_ptr ast_char::clone() const {
+    return clone_env(*this, new ast_char(value));
+}
+
 void ast_lid::print(int indent, std::ostream& to) const {
     print_indent(indent, to);
     to << "LID: " << id << std::endl;
@@ -136,16 +205,24 @@ void ast_lid::find_free(type_mgr& mgr, type_env_ptr& env, std::set<std::string>&
 }
 
 type_ptr ast_lid::typecheck(type_mgr& mgr) {
-    return env->lookup(id)->instantiate(mgr);
+    instance_type = env->lookup(id)->instantiate(mgr);
+    return instance_type;
 }
 
-void ast_lid::compile(const env_ptr& env, std::vector<instruction_ptr>& into) const {
+void ast_lid::compile(const stack_env& env, std::vector<instruction_ptr>& into) const {
     into.push_back(instruction_ptr(
-        env->has_variable(id) ?
-            (instruction*) new instruction_push(env->get_offset(id)) :
+        variable >= 0 ?
+            (instruction*) new instruction_push(env.get_offset(variable)) :
             (instruction*) new instruction_pushglobal(id)));
 }
 
+ast_ptr ast_lid::clone() const {
+    ast_lid* new_lid = new ast_lid(id);
+    new_lid->instance_type = instance_type;
+    new_lid->variable = variable;
+    return clone_env(*this, new_lid);
+}
+
 void ast_uid::print(int indent, std::ostream& to) const {
     print_indent(indent, to);
     to << "UID: " << id << std::endl;
@@ -159,10 +236,14 @@ type_ptr ast_uid::typecheck(type_mgr& mgr) {
     return env->lookup(id)->instantiate(mgr);
 }
 
-void ast_uid::compile(const env_ptr& env, std::vector<instruction_ptr>& into) const {
+void ast_uid::compile(const stack_env& env, std::vector<instruction_ptr>& into) const {
     into.push_back(instruction_ptr(new instruction_pushglobal(id)));
 }
 
+ast_ptr ast_uid::clone() const {
+    return clone_env(*this, new ast_uid(id));
+}
+
 void ast_binop::print(int indent, std::ostream& to) const {
     print_indent(indent, to);
     to << "BINOP: " << binop_name(op) << std::endl;
@@ -179,26 +260,34 @@ void ast_binop::find_free(type_mgr& mgr, type_env_ptr& env, std::set<std::string
 type_ptr ast_binop::typecheck(type_mgr& mgr) {
     type_ptr ltype = left->typecheck(mgr);
     type_ptr rtype = right->typecheck(mgr);
+    operand_type = ltype;
     type_ptr ftype = env->lookup(binop_name(op))->instantiate(mgr);
     if(!ftype) throw type_error(std::string("unknown binary operator ") + binop_name(op));
 
     type_ptr return_type = mgr.new_type();
-    type_ptr arrow_one = type_ptr(new type_arr(rtype, return_type));
-    type_ptr arrow_two = type_ptr(new type_arr(ltype, arrow_one));
+    type_ptr arrow_one = mgr.new_arr(rtype, return_type);
+    type_ptr arrow_two = mgr.new_arr(ltype, arrow_one);
 
     mgr.unify(arrow_two, ftype);
     return return_type;
 }
 
-void ast_binop::compile(const env_ptr& env, std::vector<instruction_ptr>& into) const {
+void ast_binop::compile(const stack_env& env, std::vector<instruction_ptr>& into) const {
     right->compile(env, into);
-    left->compile(env_ptr(new env_offset(1, env)), into);
+    left->compile(env.offset(1), into);
 
-    into.push_back(instruction_ptr(new instruction_pushglobal(binop_action(op))));
+    into.push_back(instruction_ptr(new instruction_pushglobal(binop_action(op, kind))));
     into.push_back(instruction_ptr(new instruction_mkapp()));
     into.push_back(instruction_ptr(new instruction_mkapp()));
 }
 
+ast_ptr ast_binop::clone() const {
+    ast_binop* new_binop = new ast_binop(op, left->clone(), right->clone());
+    new_binop->operand_type = operand_type;
+    new_binop->kind = kind;
+    return clone_env(*this, new_binop);
+}
+
 void ast_uniop::print(int indent, std::ostream& to) const {
     print_indent(indent, to);
     to << "UNIOP: " << uniop_name(op) << std::endl;
@@ -212,21 +301,29 @@ void ast_uniop::find_free(type_mgr& mgr, type_env_ptr& env, std::set<std::string
 
 type_ptr ast_uniop::typecheck(type_mgr& mgr) {
     type_ptr otype = opd->typecheck(mgr);
+    operand_type = otype;
     type_ptr ftype = env->lookup(uniop_name(op))->instantiate(mgr);
     if(!ftype) throw type_error(std::string("unknown unique operator ") + uniop_name(op));
     type_ptr return_type = mgr.new_type();
-    type_ptr arrow_type = type_ptr(new type_arr(otype, return_type));
+    type_ptr arrow_type = mgr.new_arr(otype, return_type);
     mgr.unify(arrow_type, ftype);
     return return_type;
 }
 
-void ast_uniop::compile(const env_ptr& env, std::vector<instruction_ptr>& into) const {
+void ast_uniop::compile(const stack_env& env, std::vector<instruction_ptr>& into) const {
     opd->compile(env, into);
 
-    into.push_back(instruction_ptr(new instruction_pushglobal(uniop_action(op))));
+    into.push_back(instruction_ptr(new instruction_pushglobal(uniop_action(op, kind))));
     into.push_back(instruction_ptr(new instruction_mkapp()));
 }
 
+ast_ptr ast_uniop::clone() const {
+    ast_uniop* new_uniop = new ast_uniop(op, opd->clone());
+    new_uniop->operand_type = operand_type;
+    new_uniop->kind = kind;
+    return clone_env(*this, new_uniop);
+}
+
 void ast_app::print(int indent, std::ostream& to) const {
     print_indent(indent, to);
     to << "APP: " << std::endl;
@@ -245,17 +342,50 @@ type_ptr ast_app::typecheck(type_mgr& mgr) {
     type_ptr rtype = right->typecheck(mgr);
 
     type_ptr return_type = mgr.new_type();
-    type_ptr arrow = type_ptr(new type_arr(rtype, return_type));
+    type_ptr arrow = mgr.new_arr(rtype, return_type);
     mgr.unify(arrow, ltype);
     return return_type;
 }
 
-void ast_app::compile(const env_ptr& env, std::vector<instruction_ptr>& into) const {
+void ast_app::compile(const stack_env& env, std::vector<instruction_ptr>& into) const {
     right->compile(env, into);
-    left->compile(env_ptr(new env_offset(1, env)), into);
+    left->compile(env.offset(1), into);
     into.push_back(instruction_ptr(new instruction_mkapp()));
 }
 
+void ast_app::compile_tail(const tail_context& tail, const stack_env& env, std::vector<instruction_ptr>& into) const {
+    // Collect the spine; args is in reverse order, args[0] being the last argument.
+    std::vector<const ast*> args;
+    const ast* head = this;
+    while(const ast_app* app = dynamic_cast<const ast_app*>(head)) {
+        args.push_back(app->right.get());
+        head = app->left.get();
+    }
+
+    const ast_lid* lid = dynamic_cast<const ast_lid*>(head);
+    auto callee = lid ? tail.group.find(lid->id) : tail.group.end();
+    if(callee == tail.group.end() || lid->variable >= 0 ||
+            callee->second != (int) args.size()) {
+        compile(env, into);
+        return;
+    }
+
+    // A saturated call inside the recursion group: build the new arguments only,
+    // then let them replace the current frame instead of building the application.
+    for(size_t i = 0; i < args.size(); i++) {
+        args[i]->compile(env.offset(i), into);
+    }
+    if(lid->id == tail.self) {
+        into.push_back(instruction_ptr(new instruction_selfcall(args.size(), env.depth)));
+    } else {
+        into.push_back(instruction_ptr(new instruction_tailcall(lid->id, args.size(), env.depth)));
+    }
+}
+
+ast_ptr ast_app::clone() const {
+    return clone_env(*this, new ast_app(left->clone(), right->clone()));
+}
+
 void ast_do::print(int indent, std::ostream &to) const {
     print_indent(indent, to);
     to << "DO: " << std::endl;
@@ -289,11 +419,11 @@ type_ptr ast_do::typecheck(type_mgr &mgr) {
     return return_type;
 }
 
-void ast_do::compile(const env_ptr& env, std::vector<instruction_ptr>& into) const {
+void ast_do::compile(const stack_env& env, std::vector<instruction_ptr>& into) const {
     bool last_bind = true;
     int bind_num = 0;
 
-    env_ptr cur_env = env;
+    stack_env cur_env = env;
 
     for (auto& action: actions) {
         if (!last_bind) {
@@ -306,13 +436,20 @@ void ast_do::compile(const env_ptr& env, std::vector<instruction_ptr>& into) con
         action->expr->compile(cur_env, into);
         into.push_back(instruction_ptr(new instruction_eval()));
         if (is_bind) {
-            cur_env = env_ptr(new env_var(action->bind_name, std::move(cur_env)));
+            cur_env = cur_env.bind(1);
         }
 
         last_bind = is_bind;
     }
 
     into.push_back(instruction_ptr(new instruction_slide(bind_num)));
+    env.unbind(bind_num);
+}
+
+ast_ptr ast_do::clone() const {
+    std::vector<action_ptr> new_actions;
+    for (auto& action: actions) new_actions.push_back(action->clone());
+    return clone_env(*this, new ast_do(std::move(new_actions)));
 }
 
 void action::insert_binding(type_mgr &mgr, type_env_ptr &env) {
@@ -338,13 +475,19 @@ type_ptr action_exec::typecheck(type_mgr &mgr) {
 
     if (!bind_name.empty()) {
         type_ptr io_bind_ptr = env->lookup("_IOBindCons")->instantiate(mgr);
-        type_arr* io_bind = dynamic_cast<type_arr*>(io_bind_ptr.get());
+        type_arr* io_bind = type_cast<type_arr>(io_bind_ptr.get());
         mgr.unify(env->lookup(bind_name)->instantiate(mgr), io_bind->left);
     }
 
     return body_type;
 }
 
+action_ptr action_exec::clone() const {
+    action_ptr new_action(new action_exec(bind_name, expr->clone()));
+    new_action->env = env;
+    return new_action;
+}
+
 void action_return::print(int indent, std::ostream &to) const {
     print_indent(indent, to);
     if (bind_name.empty()) {
@@ -358,7 +501,7 @@ void action_return::print(int indent, std::ostream &to) const {
 type_ptr action_return::typecheck(type_mgr &mgr) {
     type_ptr body_type = expr->typecheck(mgr);
     type_ptr return_type = mgr.new_type();
-    mgr.unify(type_ptr(new type_arr(body_type, return_type)), env->lookup("_IOBindCons")->instantiate(mgr));
+    mgr.unify(mgr.new_arr(body_type, return_type), env->lookup("_IOBindCons")->instantiate(mgr));
 
     if (!bind_name.empty()) {
         mgr.unify(env->lookup(bind_name)->instantiate(mgr), body_type);
@@ -367,6 +510,12 @@ type_ptr action_return::typecheck(type_mgr &mgr) {
     return return_type;
 }
 
+action_ptr action_return::clone() const {
+    action_ptr new_action(new action_return(bind_name, expr->clone()));
+    new_action->env = env;
+    return new_action;
+}
+
 void ast_case::print(int indent, std::ostream& to) const {
     print_indent(indent, to);
     to << "CASE: " << std::endl;
@@ -401,17 +550,35 @@ type_ptr ast_case::typecheck(type_mgr& mgr) {
 
     input_type = mgr.resolve(case_type, var);
     type_app* app_type;
-    if(!(app_type = dynamic_cast<type_app*>(input_type.get())) ||
-            !dynamic_cast<type_data*>(app_type->constructor.get())) {
+    if(!(app_type = type_cast<type_app>(input_type.get())) ||
+            !type_cast<type_data>(app_type->constructor.get())) {
         throw type_error("attempting case analysis of non-data type");
     }
 
     return branch_type;
 }
 
-void ast_case::compile(const env_ptr& env, std::vector<instruction_ptr>& into) const {
-    type_app* app_type = dynamic_cast<type_app*>(input_type.get());
-    type_data* type = dynamic_cast<type_data*>(app_type->constructor.get());
+void ast_case::compile(const stack_env& env, std::vector<instruction_ptr>& into) const {
+    compile_branches(nullptr, env, into);
+}
+
+void ast_case::compile_tail(const tail_context& tail, const stack_env& env, std::vector<instruction_ptr>& into) const {
+    compile_branches(&tail, env, into);
+}
+
+ast_ptr ast_case::clone() const {
+    std::vector<branch_ptr> new_branches;
+    for(auto& branch : branches) {
+        new_branches.push_back(branch_ptr(new struct branch(branch->pat->clone(), branch->expr->clone())));
+    }
+    ast_case* new_case = new ast_case(of->clone(), std::move(new_branches));
+    new_case->input_type = input_type;
+    return clone_env(*this, new_case);
+}
+
+void ast_case::compile_branches(const tail_context* tail, const stack_env& env, std::vector<instruction_ptr>& into) const {
+    type_app* app_type = type_cast<type_app>(input_type.get());
+    type_data* type = type_cast<type_data>(app_type->constructor.get());
 
     of->compile(env, into);
     into.push_back(instruction_ptr(new instruction_eval()));
@@ -424,28 +591,32 @@ void ast_case::compile(const env_ptr& env, std::vector<instruction_ptr>& into) c
         pattern_constr* cpat;
 
         if((vpat = dynamic_cast<pattern_var*>(branch->pat.get()))) {
-            branch->expr->compile(env_ptr(new env_offset(1, env)), branch_instructions);
+            // The evaluated scrutinee stays on the stack and is the variable's value.
+            stack_env new_env = env.bind(1);
+            if(tail) branch->expr->compile_tail(*tail, new_env, branch_instructions);
+            else branch->expr->compile(new_env, branch_instructions);
+            branch_instructions.push_back(instruction_ptr(new instruction_slide(1)));
+            env.unbind(1);
 
             for(auto& constr_pair : type->constructors) {
                 if(jump_instruction->tag_mappings.find(constr_pair.second.tag) !=
                         jump_instruction->tag_mappings.end())
-                    break;
+                    continue;
 
                 jump_instruction->tag_mappings[constr_pair.second.tag] =
                     jump_instruction->branches.size();
             }
             jump_instruction->branches.push_back(std::move(branch_instructions));
         } else if((cpat = dynamic_cast<pattern_constr*>(branch->pat.get()))) {
-            env_ptr new_env = env;
-            for(auto it = cpat->params.rbegin(); it != cpat->params.rend(); it++) {
-                new_env = env_ptr(new env_var(*it, new_env));
-            }
+            stack_env new_env = env.bind(cpat->params.size());
 
             branch_instructions.push_back(instruction_ptr(new instruction_split(
                             cpat->params.size())));
-            branch->expr->compile(new_env, branch_instructions);
+            if(tail) branch->expr->compile_tail(*tail, new_env, branch_instructions);
+            else branch->expr->compile(new_env, branch_instructions);
             branch_instructions.push_back(instruction_ptr(new instruction_slide(
                             cpat->params.size())));
+            env.unbind(cpat->params.size());
 
             int new_tag = type->constructors[cpat->constr].tag;
             if(jump_instruction->tag_mappings.find(new_tag) !=
@@ -477,6 +648,10 @@ void pattern_var::typecheck(type_ptr t, type_mgr& mgr, type_env_ptr& env) const
     mgr.unify(env->lookup(var)->instantiate(mgr), t);
 }
 
+pattern_ptr pattern_var::clone() const {
+    return pattern_ptr(new pattern_var(var));
+}
+
 void pattern_constr::print(std::ostream& to) const {
     to << constr;
     for(auto& param : params) {
@@ -485,6 +660,8 @@ void pattern_constr::print(std::ostream& to) const {
 }
 
 void pattern_constr::insert_bindings(type_mgr& mgr, type_env_ptr& env) const {
+    if(std::set<std::string>(params.begin(), params.end()).size() != params.size())
+        throw type_error("Duplicated variables in the pattern of " + constr + ".");
     for(auto& param : params) {
         env->bind(param, mgr.new_type());
     }
@@ -497,7 +674,7 @@ void pattern_constr::typecheck(type_ptr t, type_mgr& mgr, type_env_ptr& env) con
     }
 
     for(auto& param : params) {
-        type_arr* arr = dynamic_cast<type_arr*>(constructor_type.get());
+        type_arr* arr = type_cast<type_arr>(constructor_type.get());
         if(!arr) throw type_error("too many parameters in constructor pattern");
 
         mgr.unify(env->lookup(param)->instantiate(mgr), arr->left);
@@ -506,3 +683,69 @@ void pattern_constr::typecheck(type_ptr t, type_mgr& mgr, type_env_ptr& env) con
 
     mgr.unify(t, constructor_type);
 }
+
+pattern_ptr pattern_constr::clone() const {
+    return pattern_ptr(new pattern_constr(constr, params));
+}
+
+void for_each_child(ast_ptr& a, const child_visitor& f) {
+    static const std::vector<std::string> none;
+    if(auto list = dynamic_cast<ast_list*>(a.get())) {
+        for(auto& element : list->arr) f(element, none);
+    } else if(auto binop = dynamic_cast<ast_binop*>(a.get())) {
+        f(binop->left, none);
+        f(binop->right, none);
+    } else if(auto uniop = dynamic_cast<ast_uniop*>(a.get())) {
+        f(uniop->opd, none);
+    } else if(auto app = dynamic_cast<ast_app*>(a.get())) {
+        f(app->left, none);
+        f(app->right, none);
+    } else if(auto do_block = dynamic_cast<ast_do*>(a.get())) {
+        std::vector<std::string> bound;
+        for(auto& action : do_block->actions) {
+            f(action->expr, bound);
+            if(!action->bind_name.empty()) bound.push_back(action->bind_name);
+        }
+    } else if(auto case_expr = dynamic_cast<ast_case*>(a.get())) {
+        f(case_expr->of, none);
+        for(auto& branch : case_expr->branches) {
+            std::vector<std::string> bound;
+            if(auto vpat = dynamic_cast<pattern_var*>(branch->pat.get())) {
+                bound.push_back(vpat->var);
+            } else if(auto cpat = dynamic_cast<pattern_constr*>(branch->pat.get())) {
+                bound = cpat->params;
+            }
+            f(branch->expr, bound);
+        }
+    }
+}
+
+// The variables are numbered in the order compilation binds them, which is the order
+// for_each_child lists them in.
+void resolve_variables(ast_ptr& a, std::vector<std::string>& scope) {
+    if(auto lid = dynamic_cast<ast_lid*>(a.get())) {
+        lid->variable = -1;
+        for(int i = scope.size() - 1; i >= 0; i--) {
+            if(scope[i] == lid->id) {
+                lid->variable = i;
+                break;
+            }
+        }
+    }
+    for_each_child(a, [&](ast_ptr& child, const std::vector<std::string>& names) {
+        scope.insert(scope.end(), names.begin(), names.end());
+        resolve_variables(child, scope);
+        scope.resize(scope.size() - names.size());
+    });
+}
+
+void find_free_lids(ast_ptr& a, const std::set<std::string>& bound, std::set<std::string>& into) {
+    if(auto lid = dynamic_cast<ast_lid*>(a.get())) {
+        if(bound.find(lid->id) == bound.end()) into.insert(lid->id);
+    }
+    for_each_child(a, [&](ast_ptr& child, const std::vector<std::string>& names) {
+        std::set<std::string> child_bound = bound;
+        child_bound.insert(names.begin(), names.end());
+        find_free_lids(child, child_bound, into);
+    });
+}
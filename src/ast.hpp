@@ -1,4 +1,5 @@
 #pragma once
+#include <functional>
 #include <memory>
 #include <vector>
 #include <set>
@@ -18,8 +19,11 @@ struct ast {
     virtual void find_free(type_mgr& mgr,
         type_env_ptr& env, std::set<std::string>& into) = 0;
     virtual type_ptr typecheck(type_mgr& mgr) = 0;
-    virtual void compile(const env_ptr& env,
+    virtual void compile(const stack_env& env,
         std::vector<instruction_ptr>& into) const = 0;
+    virtual void compile_tail(const tail_context& tail, const stack_env& env,
+        std::vector<instruction_ptr>& into) const;
+    virtual std::unique_ptr<ast> clone() const = 0;
 };
 
 using ast_ptr = std::unique_ptr<ast>;
@@ -37,6 +41,7 @@ struct action {
     virtual void print(int indent, std::ostream& to) const = 0;
     void insert_binding(type_mgr& mgr, type_env_ptr& env);
     virtual type_ptr typecheck(type_mgr& mgr) = 0;
+    virtual std::unique_ptr<action> clone() const = 0;
 };
 
 using action_ptr = std::unique_ptr<action>;
@@ -47,6 +52,7 @@ struct pattern {
     virtual void print(std::ostream& to) const = 0;
     virtual void insert_bindings(type_mgr& mgr, type_env_ptr& env) const = 0;
     virtual void typecheck(type_ptr t, type_mgr& mgr, type_env_ptr& env) const = 0;
+    virtual std::unique_ptr<pattern> clone() const = 0;
 };
 
 using pattern_ptr = std::unique_ptr<pattern>;
@@ -62,27 +68,31 @@ struct branch {
 using branch_ptr = std::unique_ptr<branch>;
 
 struct ast_int : public ast {
-    int value;
+    int64_t value;
+    type_ptr num_type;
+    bool as_float = false;
 
-    explicit ast_int(int v)
+    explicit ast_int(int64_t v)
         : value(v) {}
 
     void print(int indent, std::ostream& to) const;
     void find_free(type_mgr& mgr, type_env_ptr& env, std::set<std::string>& into);
     type_ptr typecheck(type_mgr& mgr);
-    void compile(const env_ptr& env, std::vector<instruction_ptr>& into) const;
+    void compile(const stack_env& env, std::vector<instruction_ptr>& into) const;
+    ast_ptr clone() const;
 };
 
 struct ast_float : public ast {
-    float value;
+    double value;
 
-    explicit ast_float(float v)
+    explicit ast_float(double v)
         : value(v) {}
 
     void print(int indent, std::ostream& to) const;
     void find_free(type_mgr& mgr, type_env_ptr& env, std::set<std::string>& into);
     type_ptr typecheck(type_mgr& mgr);
-    void compile(const env_ptr& env, std::vector<instruction_ptr>& into) const;
+    void compile(const stack_env& env, std::vector<instruction_ptr>& into) const;
+    ast_ptr clone() const;
 };
 
 struct ast_char : public ast {
@@ -94,7 +104,8 @@ struct ast_char : public ast {
     void print(int indent, std::ostream& to) const;
     void find_free(type_mgr& mgr, type_env_ptr& env, std::set<std::string>& into);
     type_ptr typecheck(type_mgr& mgr);
-    void compile(const env_ptr& env, std::vector<instruction_ptr>& into) const;
+    void compile(const stack_env& env, std::vector<instruction_ptr>& into) const;
+    ast_ptr clone() const;
 };
 
 struct ast_list : public ast {
@@ -111,18 +122,23 @@ struct ast_list : public ast {
     void print(int indent, std::ostream& to) const;
     void find_free(type_mgr& mgr, type_env_ptr& env, std::set<std::string>& into);
     virtual type_ptr typecheck(type_mgr& mgr);
-    virtual void compile(const env_ptr& env, std::vector<instruction_ptr>& into) const;
+    virtual void compile(const stack_env& env, std::vector<instruction_ptr>& into) const;
+    ast_ptr clone() const;
 };
 
 struct ast_list_colon : public ast_list {
     using ast_list::ast_list;
 
     type_ptr typecheck(type_mgr& mgr);
-    void compile(const env_ptr& env, std::vector<instruction_ptr>& into) const;
+    void compile(const stack_env& env, std::vector<instruction_ptr>& into) const;
+    ast_ptr clone() const;
 };
 
 struct ast_lid : public ast {
     std::string id;
+    type_ptr instance_type;
+    // The index of the local variable this refers to in stack_env's slots, or -1 for a global.
+    int variable = -1;
 
     explicit ast_lid(std::string i)
         : id(std::move(i)) {}
@@ -130,7 +146,8 @@ struct ast_lid : public ast {
     void print(int indent, std::ostream& to) const;
     void find_free(type_mgr& mgr, type_env_ptr& env, std::set<std::string>& into);
     type_ptr typecheck(type_mgr& mgr);
-    void compile(const env_ptr& env, std::vector<instruction_ptr>& into) const;
+    void compile(const stack_env& env, std::vector<instruction_ptr>& into) const;
+    ast_ptr clone() const;
 };
 
 struct ast_uid : public ast {
@@ -142,13 +159,16 @@ struct ast_uid : public ast {
     void print(int indent, std::ostream& to) const;
     void find_free(type_mgr& mgr, type_env_ptr& env, std::set<std::string>& into);
     type_ptr typecheck(type_mgr& mgr);
-    void compile(const env_ptr& env, std::vector<instruction_ptr>& into) const;
+    void compile(const stack_env& env, std::vector<instruction_ptr>& into) const;
+    ast_ptr clone() const;
 };
 
 struct ast_binop : public ast {
     binop op;
     ast_ptr left;
     ast_ptr right;
+    type_ptr operand_type;
+    num_kind kind = NUM_GENERIC;
 
     ast_binop(binop o, ast_ptr l, ast_ptr r)
         : op(o), left(std::move(l)), right(std::move(r)) {}
@@ -156,12 +176,15 @@ struct ast_binop : public ast {
     void print(int indent, std::ostream& to) const;
     void find_free(type_mgr& mgr, type_env_ptr& env, std::set<std::string>& into);
     type_ptr typecheck(type_mgr& mgr);
-    void compile(const env_ptr& env, std::vector<instruction_ptr>& into) const;
+    void compile(const stack_env& env, std::vector<instruction_ptr>& into) const;
+    ast_ptr clone() const;
 };
 
 struct ast_uniop : public ast {
     uniop op;
     ast_ptr opd;
+    type_ptr operand_type;
+    num_kind kind = NUM_GENERIC;
 
     ast_uniop(uniop o, ast_ptr od)
         : op(o), opd(std::move(od)) {}
@@ -169,7 +192,8 @@ struct ast_uniop : public ast {
     void print(int indent, std::ostream& to) const;
     void find_free(type_mgr& mgr, type_env_ptr& env, std::set<std::string>& into);
     type_ptr typecheck(type_mgr& mgr);
-    void compile(const env_ptr& env, std::vector<instruction_ptr>& into) const;
+    void compile(const stack_env& env, std::vector<instruction_ptr>& into) const;
+    ast_ptr clone() const;
 };
 
 struct ast_app : public ast {
@@ -182,7 +206,10 @@ struct ast_app : public ast {
     void print(int indent, std::ostream& to) const;
     void find_free(type_mgr& mgr, type_env_ptr& env, std::set<std::string>& into);
     type_ptr typecheck(type_mgr& mgr);
-    void compile(const env_ptr& env, std::vector<instruction_ptr>& into) const;
+    void compile(const stack_env& env, std::vector<instruction_ptr>& into) const;
+    void compile_tail(const tail_context& tail, const stack_env& env,
+        std::vector<instruction_ptr>& into) const;
+    ast_ptr clone() const;
 };
 
 struct ast_do : public ast {
@@ -193,7 +220,8 @@ struct ast_do : public ast {
     void print(int indent, std::ostream& to) const;
     void find_free(type_mgr& mgr, type_env_ptr& env, std::set<std::string>& into);
     type_ptr typecheck(type_mgr& mgr);
-    void compile(const env_ptr& env, std::vector<instruction_ptr>& into) const;
+    void compile(const stack_env& env, std::vector<instruction_ptr>& into) const;
+    ast_ptr clone() const;
 };
 
 struct action_exec : public action {
@@ -201,6 +229,7 @@ struct action_exec : public action {
 
     void print(int indent, std::ostream& to) const;
     type_ptr typecheck(type_mgr& mgr);
+    action_ptr clone() const;
 };
 
 struct action_return : public action {
@@ -208,6 +237,7 @@ struct action_return : public action {
 
     void print(int indent, std::ostream& to) const;
     type_ptr typecheck(type_mgr& mgr);
+    action_ptr clone() const;
 };
 
 struct ast_case : public ast {
@@ -221,7 +251,14 @@ struct ast_case : public ast {
     void print(int indent, std::ostream& to) const;
     void find_free(type_mgr& mgr, type_env_ptr& env, std::set<std::string>& into);
     type_ptr typecheck(type_mgr& mgr);
-    void compile(const env_ptr& env, std::vector<instruction_ptr>& into) const;
+    void compile(const stack_env& env, std::vector<instruction_ptr>& into) const;
+    void compile_tail(const tail_context& tail, const stack_env& env,
+        std::vector<instruction_ptr>& into) const;
+    ast_ptr clone() const;
+
+    private:
+    void compile_branches(const tail_context* tail, const stack_env& env,
+        std::vector<instruction_ptr>& into) const;
 };
 
 struct pattern_var : public pattern {
@@ -233,6 +270,7 @@ struct pattern_var : public pattern {
     void print(std::ostream &to) const;
     void insert_bindings(type_mgr& mgr, type_env_ptr& env) const;
     void typecheck(type_ptr t, type_mgr& mgr, type_env_ptr& env) const;
+    pattern_ptr clone() const;
 };
 
 struct pattern_constr : public pattern {
@@ -245,4 +283,15 @@ struct pattern_constr : public pattern {
     void print(std::ostream &to) const;
     virtual void insert_bindings(type_mgr& mgr, type_env_ptr& env) const;
     virtual void typecheck(type_ptr t, type_mgr& mgr, type_env_ptr& env) const;
+    pattern_ptr clone() const;
 };
+
+using child_visitor = std::function<void(ast_ptr&, const std::vector<std::string>&)>;
+
+// Calls f on every direct subexpression of a, with the names it binds on top of a's scope.
+void for_each_child(ast_ptr& a, const child_visitor& f);
+
+// Sets the variable of each ast_lid in a, given the variables already in scope.
+void resolve_variables(ast_ptr& a, std::vector<std::string>& scope);
+// Collects the variables a refers to that are neither in bound nor bound inside a.
+void find_free_lids(ast_ptr& a, const std::set<std::string>& bound, std::set<std::string>& into);
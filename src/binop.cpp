@@ -25,7 +25,23 @@ std::string binop_name(binop op) {
     return "??";
 }
 
-std::string binop_action(binop op) {
+std::string binop_action(binop op, num_kind kind) {
+    if(binop_is_num(op)) {
+        std::string suffix = num_kind_suffix(kind);
+        switch(op) {
+            case PLUS: return "plus" + suffix;
+            case MINUS: return "minus" + suffix;
+            case TIMES: return "times" + suffix;
+            case DIVIDE: return "divide" + suffix;
+            case LT: return "lt" + suffix;
+            case GT: return "gt" + suffix;
+            case LEQ: return "leq" + suffix;
+            case GEQ: return "geq" + suffix;
+            case EQ: return "eq" + suffix;
+            case NEQ: return "neq" + suffix;
+            default: break;
+        }
+    }
     switch(op) {
         case PLUS: return "plus";
         case MINUS: return "minus";
@@ -48,4 +64,23 @@ std::string binop_action(binop op) {
         case CONN: return "concat";
     }
     return "??";
+}
+
+bool binop_is_num(binop op) {
+    switch(op) {
+        case PLUS: case MINUS: case TIMES: case DIVIDE:
+        case LT: case GT: case LEQ: case GEQ: case EQ: case NEQ:
+            return true;
+        default:
+            return false;
+    }
+}
+
+std::string num_kind_suffix(num_kind kind) {
+    switch(kind) {
+        case NUM_GENERIC: return "";
+        case NUM_INT: return "_Int";
+        case NUM_FLOAT: return "_Float";
+    }
+    return "??";
 }
\ No newline at end of file
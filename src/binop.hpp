@@ -8,5 +8,12 @@ enum binop {
     CONN,
 };
 
+// Which arithmetic an operator on Num values compiles to; see specialize.hpp.
+enum num_kind {
+    NUM_GENERIC, NUM_INT, NUM_FLOAT
+};
+
 std::string binop_name(binop op);
-std::string binop_action(binop op);
\ No newline at end of file
+std::string binop_action(binop op, num_kind kind = NUM_GENERIC);
+bool binop_is_num(binop op);
+std::string num_kind_suffix(num_kind kind);
\ No newline at end of file
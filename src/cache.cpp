@@ -0,0 +1,181 @@
+#include "cache.hpp"
+#include "ast.hpp"
+#include "instruction.hpp"
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <set>
+#include <sstream>
+#include <chrono>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MD5.h>
+
+// Bump when the layout of the entries changes; the compiler itself is covered by compiler_identity.
+static const char* cache_version = "1";
+
+/*
+    The prelude, the runtime interface and code generation change with the compiler
+    itself, so every key includes the size and modification time of its executable.
+    If it cannot be found, the keys are made unique and nothing is reused.
+*/
+static std::string compiler_identity() {
+    std::string path = llvm::sys::fs::getMainExecutable(nullptr, (void*) &compiler_identity);
+    llvm::sys::fs::file_status status;
+    if(path.empty() || llvm::sys::fs::status(path, status)) {
+        return "unknown " + std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+    }
+    return std::to_string(status.getSize()) + " " +
+        std::to_string(status.getLastModificationTime().time_since_epoch().count());
+}
+
+static std::string hash_text(const std::string& text) {
+    llvm::MD5 md5;
+    md5.update(text);
+    llvm::MD5::MD5Result result;
+    md5.final(result);
+    return result.digest().str().str();
+}
+
+// Prints the G-code exactly (unlike instruction::print, which rounds floats and
+// leaves out jump tables) and collects the globals it refers to.
+static void write_gcode(const std::vector<instruction_ptr>& instructions,
+        std::ostream& to, std::set<std::string>& globals) {
+    for(auto& instruction : instructions) {
+        if(auto jump = dynamic_cast<const instruction_jump*>(instruction.get())) {
+            to << "Jump(";
+            for(auto& mapping : jump->tag_mappings) to << mapping.first << ":" << mapping.second << " ";
+            to << ")" << std::endl;
+            for(auto& branch : jump->branches) {
+                write_gcode(branch, to, globals);
+                to << "EndBranch()" << std::endl;
+            }
+            continue;
+        }
+        if(auto global = dynamic_cast<const instruction_pushglobal*>(instruction.get())) {
+            globals.insert(global->name);
+        } else if(auto app = dynamic_cast<const instruction_pushapp*>(instruction.get())) {
+            globals.insert(app->name);
+        } else if(auto call = dynamic_cast<const instruction_tailcall*>(instruction.get())) {
+            globals.insert(call->name);
+        }
+        instruction->print(0, to);
+    }
+}
+
+// Writes t with each variable numbered by its first occurrence, since the names the
+// type checker gives variables depend on everything checked before (and, with
+// --jobs, on the order the threads ran in).
+static void write_type(const type_ptr& t, std::map<std::string, int>& numbers,
+        std::vector<bool>& num_vars, std::ostream& to) {
+    switch(t->kind) {
+        case TYPE_VAR: {
+            type_var* var = static_cast<type_var*>(t.get());
+            auto number = numbers.emplace(var->name, numbers.size());
+            if(number.second) num_vars.push_back(var->num_type);
+            to << " ?" << number.first->second;
+            break;
+        }
+        case TYPE_BASE:
+        case TYPE_DATA:
+            to << " " << static_cast<type_base*>(t.get())->name;
+            break;
+        case TYPE_ARR: {
+            type_arr* arr = static_cast<type_arr*>(t.get());
+            to << " ->";
+            write_type(arr->left, numbers, num_vars, to);
+            write_type(arr->right, numbers, num_vars, to);
+            break;
+        }
+        case TYPE_APP: {
+            type_app* app = static_cast<type_app*>(t.get());
+            to << " @" << app->arguments.size();
+            write_type(app->constructor, numbers, num_vars, to);
+            for(auto& argument : app->arguments) write_type(argument, numbers, num_vars, to);
+            break;
+        }
+    }
+}
+
+static void write_scheme(const type_env_ptr& env, const type_mgr& mgr,
+        const std::string& name, std::ostream& to) {
+    auto scheme = env->lookup(name);
+    if(scheme) {
+        std::map<std::string, int> numbers;
+        std::vector<bool> num_vars;
+        write_type(mgr.expand(scheme->monotype), numbers, num_vars, to);
+        // The quantified variables by number, as forall's order also follows the names.
+        std::map<int, bool> quantified;
+        for(auto& var : scheme->forall) {
+            auto number = numbers.find(var.first);
+            if(number != numbers.end()) quantified[number->second] = var.second;
+        }
+        for(auto& var : quantified) to << " forall " << var.first << (var.second ? "n" : "");
+        for(size_t i = 0; i < num_vars.size(); i++) {
+            if(num_vars[i]) to << " num " << i;
+        }
+    }
+    to << std::endl;
+}
+
+void compile_cache::compute_keys(
+        const std::map<std::string, definition_data_ptr>& defs_data,
+        const std::map<std::string, definition_defn_ptr>& defs_defn,
+        const type_mgr& mgr, const type_env_ptr& env, const compiler_options& options,
+        const std::map<std::string, llvm_context::external_global>& imported) {
+    std::ostringstream builtins;
+    builtins << cache_version << " " << compiler_identity() << " " << llvm::sys::getDefaultTargetTriple() << " "
+        << options.wide_numbers << options.bounds_checks << std::endl;
+    for(auto& def_data : defs_data) {
+        builtins << "data " << def_data.first << " " << def_data.second->vars.size() << ":";
+        for(auto& constructor : def_data.second->constructors) {
+            builtins << " " << constructor->name << "/" << constructor->types.size();
+        }
+        builtins << std::endl;
+    }
+    // The imported modules' globals are pushed like the builtins.
+    for(auto& global : imported) {
+        builtins << "import " << global.first << " " << global.second.arity << " " << global.second.shared << std::endl;
+    }
+    builtins_key = hash_text(builtins.str());
+
+    for(auto& def_defn : defs_defn) {
+        auto& def = *def_defn.second;
+        std::ostringstream gcode;
+        gcode.precision(std::numeric_limits<double>::max_digits10);
+        std::set<std::string> globals;
+        write_gcode(def.instructions, gcode, globals);
+        listings[def.name] = gcode.str();
+
+        std::ostringstream key;
+        key << builtins_key << std::endl;
+        key << "defn " << def.name << " " << def.params.size() << " " << def.caf << std::endl;
+        def.body->print(0, key);
+        write_scheme(env, mgr, def.name, key);
+        // A global's arity and sharing decide how it is pushed; builtins are covered by builtins_key.
+        for(auto& global : globals) {
+            auto dependency = defs_defn.find(global);
+            if(dependency == defs_defn.end()) continue;
+            key << "uses " << global << " " << dependency->second->params.size() << " "
+                << dependency->second->caf << std::endl;
+            write_scheme(env, mgr, global, key);
+        }
+        keys[def.name] = hash_text(key.str());
+    }
+}
+
+std::string compile_cache::object_path(const std::string& key) const {
+    return directory + "/" + key + ".o";
+}
+
+bool compile_cache::has(const std::string& key, const std::string& listing) const {
+    std::ifstream file(directory + "/" + key + ".gcode", std::ios::binary);
+    if(!file.is_open()) return false;
+    std::string stored((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return stored == listing && std::ifstream(object_path(key)).good();
+}
+
+void compile_cache::store(const std::string& key, const std::string& listing) const {
+    std::ofstream file(directory + "/" + key + ".gcode", std::ios::binary | std::ios::trunc);
+    file << listing;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <map>
+#include <string>
+#include "definition.hpp"
+#include "options.hpp"
+#include "type.hpp"
+#include "type_env.hpp"
+
+/*
+    The on-disk cache behind --cache. Each definition is emitted as a module of
+    its own, and its entry holds that module's object code and the G-code it was
+    generated from. Entries are named by a hash of the definition's final AST, the
+    inferred types of it and of the globals it uses, and everything else the
+    object code depends on, so an edit only misses the definitions that see it.
+*/
+struct compile_cache {
+    std::string directory;
+    // The entry of the module holding the builtins; every definition's key includes it.
+    std::string builtins_key;
+    std::map<std::string, std::string> keys;
+    std::map<std::string, std::string> listings;
+
+    compile_cache(std::string d) : directory(std::move(d)) {}
+
+    // Must run after compilation, since the G-code shows which globals a definition uses.
+    void compute_keys(
+            const std::map<std::string, definition_data_ptr>& defs_data,
+            const std::map<std::string, definition_defn_ptr>& defs_defn,
+            const type_mgr& mgr, const type_env_ptr& env, const compiler_options& options,
+            const std::map<std::string, llvm_context::external_global>& imported);
+
+    std::string object_path(const std::string& key) const;
+    // Whether key's object code is complete and was made from the same G-code.
+    bool has(const std::string& key, const std::string& listing) const;
+    // Marks key's object code as complete.
+    void store(const std::string& key, const std::string& listing) const;
+};
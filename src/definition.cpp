@@ -6,6 +6,7 @@
 #include "type.hpp"
 #include "type_env.hpp"
 #include <algorithm>
+#include <queue>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Type.h>
@@ -14,12 +15,14 @@ void definition_defn::find_free(type_mgr& mgr, type_env_ptr& env) {
     this->env = env;
 
     var_env = type_scope(env);
+    if(std::set<std::string>(params.begin(), params.end()).size() != params.size())
+        throw type_error("Duplicated parameters in the definition of " + name + ".");
     return_type = mgr.new_type();
     full_type = return_type;
 
     for(auto it = params.rbegin(); it != params.rend(); it++) {
         type_ptr param_type = mgr.new_type();
-        full_type = type_ptr(new type_arr(param_type, full_type));
+        full_type = mgr.new_arr(param_type, full_type);
         var_env->bind(*it, param_type);
     }
 
@@ -35,28 +38,77 @@ void definition_defn::typecheck(type_mgr& mgr) {
     mgr.unify(return_type, body_type);
 }
 
-void definition_defn::compile() {
-    env_ptr new_env = env_ptr(new env_offset(0, nullptr));
-    for(auto it = params.rbegin(); it != params.rend(); it++) {
-        new_env = env_ptr(new env_var(*it, new_env));
+void definition_defn::mark_caf(const type_mgr& mgr) {
+    // IO actions run every time they are evaluated, so they can't be shared.
+    // A bare type variable might still be instantiated to IO at a use site.
+    type_var* var;
+    type_ptr resolved = mgr.resolve(return_type, var);
+    if(!params.empty() || (var && !var->num_type)) return;
+    if(type_app* app = type_cast<type_app>(resolved.get())) {
+        type_base* constructor = type_cast<type_base>(mgr.resolve(app->constructor, var).get());
+        if(constructor && constructor->name == "IO") return;
     }
-    body->compile(new_env, instructions);
+    caf = true;
+}
+
+void definition_defn::compile(const std::map<std::string, int>& group) {
+    std::vector<std::string> scope = params;
+    resolve_variables(body, scope);
+
+    env_slots slots;
+    stack_env new_env = stack_env(slots, 0).bind(params.size());
+    body->compile_tail(tail_context { name, group }, new_env, instructions);
     instructions.push_back(instruction_ptr(new instruction_update(params.size())));
     instructions.push_back(instruction_ptr(new instruction_pop(params.size())));
 }
 
 void definition_defn::declare_llvm(llvm_context& ctx) {
-    generated_function = ctx.create_custom_function(name, params.size());
+    generated_function = ctx.create_custom_function(name, params.size(), caf);
 }
 
 void definition_defn::generate_llvm(llvm_context& ctx) {
+    // The body gets its own block so that self tail calls can jump back to it.
+    auto body_block = llvm::BasicBlock::Create(ctx.ctx, "body", generated_function);
     ctx.builder.SetInsertPoint(&generated_function->getEntryBlock());
+    ctx.builder.CreateBr(body_block);
+    ctx.builder.SetInsertPoint(body_block);
     for(auto& instruction : instructions) {
         instruction->gen_llvm(ctx, generated_function);
     }
     ctx.builder.CreateRetVoid();
 }
 
+std::vector<std::string> remove_unreferenced(
+        std::map<std::string, definition_defn_ptr>& defs_defn,
+        const std::function<bool(const definition_defn&)>& removable) {
+    std::map<std::string, int> referrers;
+    for(auto& def_defn : defs_defn) {
+        for(auto& dependency : def_defn.second->free_variables) {
+            if(dependency != def_defn.first && defs_defn.count(dependency)) referrers[dependency]++;
+        }
+    }
+
+    std::queue<std::string> unreferenced;
+    for(auto& def_defn : defs_defn) {
+        if(!referrers[def_defn.first] && removable(*def_defn.second)) unreferenced.push(def_defn.first);
+    }
+
+    std::vector<std::string> removed;
+    while(!unreferenced.empty()) {
+        std::string name = std::move(unreferenced.front());
+        unreferenced.pop();
+        auto def = defs_defn.find(name);
+        for(auto& dependency : def->second->free_variables) {
+            auto dependency_def = defs_defn.find(dependency);
+            if(dependency == name || dependency_def == defs_defn.end()) continue;
+            if(!--referrers[dependency] && removable(*dependency_def->second)) unreferenced.push(dependency);
+        }
+        defs_defn.erase(def);
+        removed.push_back(std::move(name));
+    }
+    return removed;
+}
+
 void definition_data::insert_types(type_env_ptr& env) {
     this->env = env;
     env->bind_type(name, type_ptr(new type_data(name, vars.size())));
@@ -99,7 +151,7 @@ void definition_data::insert_constructors() const {
 void definition_data::generate_llvm(llvm_context& ctx) {
     for(auto& constructor : constructors) {
         auto new_function =
-            ctx.create_custom_function(constructor->name, constructor->types.size());
+            ctx.create_custom_function(constructor->name, constructor->types.size(), true);
         std::vector<instruction_ptr> instructions;
         instructions.push_back(instruction_ptr(
                 new instruction_pack(constructor->tag, constructor->types.size())
@@ -1,4 +1,6 @@
 #pragma once
+#include <functional>
+#include <map>
 #include <memory>
 #include <vector>
 #include <set>
@@ -32,6 +34,11 @@ struct definition_defn {
     type_ptr full_type;
     type_ptr return_type;
 
+    // Zero-arity definitions whose value can be computed once and shared.
+    bool caf = false;
+    // Part of a module's interface, so kept even when nothing in the module refers to it.
+    bool exported = false;
+
     std::vector<instruction_ptr> instructions;
 
     llvm::Function* generated_function;
@@ -42,13 +49,21 @@ struct definition_defn {
     void find_free(type_mgr& mgr, type_env_ptr& env);
     void insert_types(type_mgr& mgr);
     void typecheck(type_mgr& mgr);
-    void compile();
+    void mark_caf(const type_mgr& mgr);
+    void compile(const std::map<std::string, int>& group);
     void declare_llvm(llvm_context& ctx);
     void generate_llvm(llvm_context& ctx);
 };
 
 using definition_defn_ptr = std::unique_ptr<definition_defn>;
 
+// Erases the removable definitions no other definition refers to, including those
+// left unreferenced by earlier removals, and returns their names in removal order.
+// Relies on free_variables being up to date.
+std::vector<std::string> remove_unreferenced(
+        std::map<std::string, definition_defn_ptr>& defs_defn,
+        const std::function<bool(const definition_defn&)>& removable);
+
 struct definition_data {
     std::string name;
     std::vector<std::string> vars;
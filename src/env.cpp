@@ -1,24 +1,12 @@
 #include "env.hpp"
-#include "error.hpp"
 
-int env_var::get_offset(const std::string& name) const {
-    if(name == this->name) return 0;
-    if(parent) return parent->get_offset(name) + 1;
-    throw unexpected_error("env_var::get_offset: name not found");
+stack_env stack_env::bind(size_t count) const {
+    for(size_t i = 0; i < count; i++) {
+        slots->push_back(depth + count - 1 - i);
+    }
+    return offset(count);
 }
 
-bool env_var::has_variable(const std::string& name) const {
-    if(name == this->name) return true;
-    if(parent) return parent->has_variable(name);
-    return false;
-}
-
-int env_offset::get_offset(const std::string& name) const {
-    if(parent) return parent->get_offset(name) + offset;
-    throw unexpected_error("env_offset::get_offset: name not found");
-}
-
-bool env_offset::has_variable(const std::string& name) const {
-    if(parent) return parent->has_variable(name);
-    return false;
+void stack_env::unbind(size_t count) const {
+    slots->resize(slots->size() - count);
 }
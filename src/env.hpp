@@ -1,34 +1,33 @@
 #pragma once
-#include <memory>
+#include <map>
 #include <string>
-
-struct env {
-    virtual ~env() = default;
-
-    virtual int get_offset(const std::string& name) const = 0;
-    virtual bool has_variable(const std::string& name) const = 0;
+#include <vector>
+
+// The stack slot (counted from the bottom of the frame) of each variable in scope while
+// compiling a function, in the order they were bound. A variable's index in it is known
+// before compiling, see resolve_variables.
+using env_slots = std::vector<int>;
+
+// The compile-time view of a function's stack frame: the variables in scope
+// and the number of nodes currently on the frame.
+struct stack_env {
+    env_slots* slots;
+    int depth;
+
+    stack_env(env_slots& s, int d)
+        : slots(&s), depth(d) {}
+
+    // The same scope with n more (unnamed) nodes pushed on top.
+    stack_env offset(int n) const { return stack_env(*slots, depth + n); }
+    // Binds the next count nodes pushed as the next count variables, the first
+    // of them ending up on top. They stay in scope until unbind is called with the same count.
+    stack_env bind(size_t count) const;
+    void unbind(size_t count) const;
+
+    int get_offset(int variable) const { return depth - 1 - (*slots)[variable]; }
 };
 
-using env_ptr = std::shared_ptr<env>;
-
-struct env_var : public env {
-    std::string name;
-    env_ptr parent;
-
-    env_var(std::string& n, env_ptr p)
-        : name(std::move(n)), parent(std::move(p)) {}
-
-    int get_offset(const std::string& name) const;
-    bool has_variable(const std::string& name) const;
-};
-
-struct env_offset : public env {
-    int offset;
-    env_ptr parent;
-
-    env_offset(int o, env_ptr p)
-        : offset(o), parent(std::move(p)) {}
-
-    int get_offset(const std::string& name) const;
-    bool has_variable(const std::string& name) const;
+struct tail_context {
+    std::string self;
+    std::map<std::string, int> group;  // arities of the functions in self's recursion group
 };
@@ -0,0 +1,213 @@
+#include "inliner.hpp"
+#include <set>
+#include <vector>
+#include "ast.hpp"
+#include "graph.hpp"
+
+static int ast_size(ast_ptr& a) {
+    int size = 1;
+    for_each_child(a, [&](ast_ptr& child, const std::vector<std::string>&) {
+        size += ast_size(child);
+    });
+    return size;
+}
+
+static void find_binders(ast_ptr& a, std::set<std::string>& into) {
+    for_each_child(a, [&](ast_ptr& child, const std::vector<std::string>& names) {
+        into.insert(names.begin(), names.end());
+        find_binders(child, into);
+    });
+}
+
+static int count_uses(ast_ptr& a, const std::string& name) {
+    if(auto lid = dynamic_cast<ast_lid*>(a.get())) return lid->id == name;
+    int count = 0;
+    for_each_child(a, [&](ast_ptr& child, const std::vector<std::string>& names) {
+        for(auto& bound : names) if(bound == name) return;
+        count += count_uses(child, name);
+    });
+    return count;
+}
+
+// Adds one to references[name] for every use of a definition name that a does not bind.
+static void count_references(ast_ptr& a, std::map<std::string, int>& bound,
+        std::map<std::string, int>& references) {
+    if(auto lid = dynamic_cast<ast_lid*>(a.get())) {
+        auto reference = references.find(lid->id);
+        if(reference != references.end() && !bound[lid->id]) reference->second++;
+        return;
+    }
+    for_each_child(a, [&](ast_ptr& child, const std::vector<std::string>& names) {
+        for(auto& name : names) bound[name]++;
+        count_references(child, bound, references);
+        for(auto& name : names) bound[name]--;
+    });
+}
+
+static void substitute(ast_ptr& a, const std::map<std::string, const ast*>& with) {
+    if(auto lid = dynamic_cast<ast_lid*>(a.get())) {
+        auto found = with.find(lid->id);
+        if(found != with.end()) a = found->second->clone();
+        return;
+    }
+    for_each_child(a, [&](ast_ptr& child, const std::vector<std::string>& names) {
+        std::map<std::string, const ast*> child_with = with;
+        for(auto& bound : names) child_with.erase(bound);
+        substitute(child, child_with);
+    });
+}
+
+// Duplicating these loses no sharing.
+static bool is_trivial(const ast* a) {
+    return dynamic_cast<const ast_lid*>(a) || dynamic_cast<const ast_uid*>(a) ||
+        dynamic_cast<const ast_int*>(a) || dynamic_cast<const ast_float*>(a) ||
+        dynamic_cast<const ast_char*>(a);
+}
+
+struct inliner {
+    std::map<std::string, definition_defn_ptr>& defs_defn;
+    std::map<std::string, definition_defn*> candidates;
+    std::map<std::string, int> inlined;
+
+    inliner(std::map<std::string, definition_defn_ptr>& d)
+        : defs_defn(d) {}
+
+    // Copying an atom, or a partial application whose arguments are values, duplicates
+    // no work, so CAFs and arguments used more than once may be copied only if they are values.
+    bool is_value(ast_ptr& body) const {
+        if(is_trivial(body.get())) return true;
+        int args = 0;
+        ast_ptr* head = &body;
+        while(auto app = dynamic_cast<ast_app*>(head->get())) {
+            if(!is_value(app->right)) return false;
+            head = &app->left;
+            args++;
+        }
+        auto lid = dynamic_cast<ast_lid*>(head->get());
+        if(!lid) return false;
+        auto def = defs_defn.find(lid->id);
+        return def != defs_defn.end() && (int) def->second->params.size() > args;
+    }
+
+    bool try_inline(ast_ptr& a, const std::set<std::string>& scope);
+    void rewrite(ast_ptr& a, const std::set<std::string>& scope);
+};
+
+bool inliner::try_inline(ast_ptr& a, const std::set<std::string>& scope) {
+    // Collect the spine; args is in reverse order, args[0] being the last argument.
+    std::vector<ast_ptr*> args;
+    ast_ptr* head = &a;
+    while(auto app = dynamic_cast<ast_app*>(head->get())) {
+        args.push_back(&app->right);
+        head = &app->left;
+    }
+
+    auto lid = dynamic_cast<ast_lid*>(head->get());
+    if(!lid || scope.find(lid->id) != scope.end()) return false;
+    auto candidate = candidates.find(lid->id);
+    if(candidate == candidates.end()) return false;
+    definition_defn* def = candidate->second;
+    size_t arity = def->params.size();
+    if(args.size() < arity) return false;
+
+    // The body must not see the caller's locals, and the arguments must not see the body's.
+    std::set<std::string> body_free;
+    std::set<std::string> body_binders;
+    find_free_lids(def->body, std::set<std::string>(def->params.begin(), def->params.end()), body_free);
+    find_binders(def->body, body_binders);
+    for(auto& name : body_free) {
+        if(scope.find(name) != scope.end()) return false;
+    }
+
+    std::map<std::string, const ast*> with;
+    for(size_t i = 0; i < arity; i++) {
+        ast_ptr& arg = *args[args.size() - 1 - i];
+        if(!is_value(arg) && count_uses(def->body, def->params[i]) > 1) return false;
+        std::set<std::string> arg_free;
+        find_free_lids(arg, std::set<std::string>(), arg_free);
+        for(auto& name : arg_free) {
+            if(body_binders.find(name) != body_binders.end()) return false;
+        }
+        with[def->params[i]] = arg.get();
+    }
+
+    ast_ptr result = def->body->clone();
+    substitute(result, with);
+    for(size_t i = arity; i < args.size(); i++) {
+        ast_ptr& arg = *args[args.size() - 1 - i];
+        ast_ptr app(new ast_app(std::move(result), std::move(arg)));
+        app->env = a->env;
+        result = std::move(app);
+    }
+    a = std::move(result);
+    inlined[def->name]++;
+    return true;
+}
+
+void inliner::rewrite(ast_ptr& a, const std::set<std::string>& scope) {
+    for_each_child(a, [&](ast_ptr& child, const std::vector<std::string>& names) {
+        std::set<std::string> child_scope = scope;
+        child_scope.insert(names.begin(), names.end());
+        rewrite(child, child_scope);
+    });
+    // The substituted body may expose new calls, e.g. a parameter applied to arguments.
+    if(try_inline(a, scope)) rewrite(a, scope);
+}
+
+void inline_program(std::map<std::string, definition_defn_ptr>& defs_defn,
+        const compiler_options& options, std::ostream& log) {
+    function_graph dependency_graph;
+    std::map<std::string, int> references;
+    for(auto& def_defn : defs_defn) {
+        dependency_graph.add_function(def_defn.second->name);
+        for(auto& dependency : def_defn.second->free_variables) {
+            if(defs_defn.find(dependency) == defs_defn.end()) continue;
+            dependency_graph.add_edge(def_defn.second->name, dependency);
+        }
+    }
+    for(auto& def_defn : defs_defn) references[def_defn.first] = 0;
+    for(auto& def_defn : defs_defn) {
+        auto& def = def_defn.second;
+        std::map<std::string, int> bound;
+        for(auto& param : def->params) bound[param]++;
+        count_references(def->body, bound, references);
+    }
+
+    // Callees come last in the order, so walking it backwards inlines into a body only once it is final.
+    inliner pass(defs_defn);
+    std::vector<group_ptr> groups = dependency_graph.compute_order();
+    for(auto it = groups.rbegin(); it != groups.rend(); it++) {
+        auto& group = *it;
+        for(auto& name : group->members) {
+            auto& def = defs_defn.find(name)->second;
+            pass.rewrite(def->body, std::set<std::string>(def->params.begin(), def->params.end()));
+        }
+
+        if(group->members.size() != 1) continue;
+        auto& def = defs_defn.find(*group->members.begin())->second;
+        if(def->name == "main" || def->free_variables.count(def->name)) continue;
+        bool small = ast_size(def->body) <= options.inline_size;
+        bool single_use = options.inline_single_use && references[def->name] == 1;
+        if(!small && !single_use) continue;
+        if(def->params.empty() && !pass.is_value(def->body)) continue;
+        pass.candidates[def->name] = def.get();
+    }
+
+    for(auto& def_defn : defs_defn) {
+        auto& def = def_defn.second;
+        def->free_variables.clear();
+        find_free_lids(def->body, std::set<std::string>(def->params.begin(), def->params.end()), def->free_variables);
+    }
+
+    // Removing one definition may leave another without references, which is then removed too.
+    auto removed_order = remove_unreferenced(defs_defn, [&](const definition_defn& def) {
+        return !def.exported && pass.inlined.count(def.name);
+    });
+    std::set<std::string> removed(removed_order.begin(), removed_order.end());
+
+    for(auto& inlined : pass.inlined) {
+        log << inlined.first << ": inlined at " << inlined.second << " site(s)";
+        if(removed.count(inlined.first)) log << ", removed";
+        log << "\n";
+    }
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <map>
+#include <ostream>
+#include <string>
+#include "definition.hpp"
+#include "options.hpp"
+
+// Substitutes small and single-use non-recursive definitions into their callers.
+// Must run after typechecking; definitions that are no longer referenced are removed.
+void inline_program(std::map<std::string, definition_defn_ptr>& defs_defn,
+        const compiler_options& options, std::ostream& log);
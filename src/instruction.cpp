@@ -1,5 +1,6 @@
 #include "instruction.hpp"
 #include "llvm_context.hpp"
+#include "error.hpp"
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Function.h>
 
@@ -15,7 +16,7 @@ void instruction_pushint::print(int indent, std::ostream& to) const {
 }
 
 void instruction_pushint::gen_llvm(llvm_context& ctx, Function* f) const {
-    ctx.create_push(f, ctx.create_num(f, ctx.create_i32(value)));
+    ctx.create_push(f, ctx.create_num(f, ctx.create_int_value(value)));
 }
 
 void instruction_pushfloat::print(int indent, std::ostream& to) const {
@@ -24,7 +25,7 @@ void instruction_pushfloat::print(int indent, std::ostream& to) const {
 }
 
 void instruction_pushfloat::gen_llvm(llvm_context& ctx, Function* f) const {
-    ctx.create_push(f, ctx.create_float(f, ctx.create_f32(value)));
+    ctx.create_push(f, ctx.create_float(f, ctx.create_float_value(value)));
 }
 
 void instruction_pushchar::print(int indent, std::ostream& to) const {
@@ -36,6 +37,33 @@ void instruction_pushchar::gen_llvm(llvm_context& ctx, Function* f) const {
     ctx.create_pack(f, ctx.create_size(0), ctx.create_i8(value));
 }
 
+void literal::print(std::ostream& to) const {
+    switch(kind) {
+        case INT: to << int_value; break;
+        case FLOAT: to << float_value; break;
+        case CHAR: to << "'" << char_value << "'"; break;
+        case LIST:
+            to << "[";
+            for(size_t i = 0; i < elements.size(); i++) {
+                if(i) to << ", ";
+                elements[i].print(to);
+            }
+            to << "]";
+            break;
+    }
+}
+
+void instruction_pushliteral::print(int indent, std::ostream& to) const {
+    print_indent(indent, to);
+    to << "PushLiteral(";
+    value.print(to);
+    to << ")" << std::endl;
+}
+
+void instruction_pushliteral::gen_llvm(llvm_context& ctx, Function* f) const {
+    ctx.create_push(f, ctx.create_literal(value));
+}
+
 void instruction_pushglobal::print(int indent, std::ostream& to) const {
     print_indent(indent, to);
     to << "PushGlobal(" << name << ")" << std::endl;
@@ -43,15 +71,36 @@ void instruction_pushglobal::print(int indent, std::ostream& to) const {
 
 void instruction_pushglobal::gen_llvm(llvm_context& ctx, Function* f) const {
     try {
-        auto& global_f = ctx.custom_functions.at("f_" + name);
-        auto arity = ctx.create_i32(global_f->arity);
-        ctx.create_push(f, ctx.create_global(f, global_f->function, arity));
+        auto& global_f = ctx.get_custom_function("f_" + name);
+        ctx.create_push(f, ctx.create_global_ref(f, *global_f));
     } catch (std::out_of_range& err) {
         // This is only used during development: some functions/operations have not been implemented yet.
         // Remove this try-catch if all funcs/ops are ready.
     }
 }
 
+void instruction_pushapp::print(int indent, std::ostream& to) const {
+    print_indent(indent, to);
+    to << "PushApp(" << name << ", " << count << ")" << std::endl;
+}
+
+void instruction_pushapp::gen_llvm(llvm_context& ctx, Function* f) const {
+    // Same as PushGlobal followed by count MkApps. Each new node points to the previous one,
+    // so tracking it keeps the whole spine reachable.
+    // Unlike PushGlobal, skipping an unknown global would leave the count arguments on the stack.
+    llvm_context::custom_function* global_f;
+    try {
+        global_f = ctx.get_custom_function("f_" + name).get();
+    } catch (std::out_of_range& err) {
+        throw unexpected_error("instruction_pushapp::gen_llvm: unknown global " + name);
+    }
+    auto node = ctx.create_global_ref(f, *global_f);
+    for(int i = 0; i < count; i++) {
+        node = ctx.create_app(f, node, ctx.create_pop(f));
+    }
+    ctx.create_push(f, node);
+}
+
 void instruction_push::print(int indent, std::ostream& to) const {
     print_indent(indent, to);
     to << "Push(" << offset << ")" << std::endl;
@@ -154,9 +203,66 @@ void instruction_slide::gen_llvm(llvm_context& ctx, Function* f) const {
     ctx.create_slide(f, ctx.create_size(offset));
 }
 
+static bool is_comparison(binop op) {
+    return op == LT || op == GT || op == LEQ || op == GEQ || op == EQ || op == NEQ;
+}
+
+// An i32 result, or an i1 for comparisons.
+static Value* create_int_binop(llvm_context& ctx, binop op, Value* left, Value* right) {
+    switch(op) {
+        case PLUS: return ctx.builder.CreateAdd(left, right);
+        case MINUS: return ctx.builder.CreateSub(left, right);
+        case TIMES: return ctx.builder.CreateMul(left, right);
+        case DIVIDE: return ctx.builder.CreateSDiv(left, right);
+        case BMOD: return ctx.builder.CreateSRem(left, right);
+        case LMOVE: return ctx.builder.CreateShl(left, right);
+        case RMOVE: return ctx.builder.CreateAShr(left, right);
+        case BITAND: return ctx.builder.CreateAnd(left, right);
+        case BITOR: return ctx.builder.CreateOr(left, right);
+        case XOR: return ctx.builder.CreateXor(left, right);
+        case LT: return ctx.builder.CreateICmpSLT(left, right);
+        case GT: return ctx.builder.CreateICmpSGT(left, right);
+        case LEQ: return ctx.builder.CreateICmpSLE(left, right);
+        case GEQ: return ctx.builder.CreateICmpSGE(left, right);
+        case EQ: return ctx.builder.CreateICmpEQ(left, right);
+        case NEQ: return ctx.builder.CreateICmpNE(left, right);
+        default: throw unexpected_error("create_int_binop: not an integer operation.");
+    }
+}
+
+// A float result, or an i1 for comparisons.
+static Value* create_float_binop(llvm_context& ctx, binop op, Value* left, Value* right) {
+    switch(op) {
+        case PLUS: return ctx.builder.CreateFAdd(left, right);
+        case MINUS: return ctx.builder.CreateFSub(left, right);
+        case TIMES: return ctx.builder.CreateFMul(left, right);
+        case DIVIDE: return ctx.builder.CreateFDiv(left, right);
+        case LT: return ctx.builder.CreateFCmpOLT(left, right);
+        case GT: return ctx.builder.CreateFCmpOGT(left, right);
+        case LEQ: return ctx.builder.CreateFCmpOLE(left, right);
+        case GEQ: return ctx.builder.CreateFCmpOGE(left, right);
+        case EQ: return ctx.builder.CreateFCmpOEQ(left, right);
+        case NEQ: return ctx.builder.CreateFCmpUNE(left, right);
+        default: throw unexpected_error("create_float_binop: not a float operation.");
+    }
+}
+
+static void push_num_result(llvm_context& ctx, Function* f, binop op, Value* result, bool is_float) {
+    if (is_comparison(op)) {
+        // For (num -> (num -> (Bool*))) operations, we need to simulate a Data constructor here.
+        // See instruction.cpp - void instruction_pack::gen_llvm and definition.cpp - void definition_data::generate_llvm.
+        ctx.create_pack(f, ctx.create_size(0),  // The constructor takes 0 elements in the stack (or, arity = 0).
+                ctx.builder.CreateSelect(result, ctx.create_i8(1), ctx.create_i8(0)));  // The constructor-tag is 1 (True) or 0 (False), depanded on result.
+    } else if (is_float) {
+        ctx.create_push(f, ctx.create_float(f, result));
+    } else {
+        ctx.create_push(f, ctx.create_num(f, result));
+    }
+}
+
 void instruction_binop::print(int indent, std::ostream& to) const {
     print_indent(indent, to);
-    to << "BinOp(" << binop_name(op) << ")" << std::endl;
+    to << "BinOp(" << binop_name(op) << num_kind_suffix(kind) << ")" << std::endl;
 }
 
 void instruction_binop::gen_llvm(llvm_context& ctx, Function* f) const {
@@ -175,12 +281,12 @@ void instruction_binop::gen_llvm(llvm_context& ctx, Function* f) const {
         ctx.create_split(f, ctx.create_size(2));
         ctx.create_disablegc(f);
         auto n_x = ctx.create_pop(f);
-        auto recur_conn = ctx.create_global(f, f, ctx.create_i32(2));
+        auto recur_conn = ctx.create_global_ref(f, *ctx.get_custom_function("f_" + binop_action(CONN)));
         auto n_xs = ctx.create_pop(f);
         auto n_app_conn_xs = ctx.create_app(f, recur_conn, n_xs);
         auto right_list_cons = ctx.create_pop(f);
         auto n_app_conn = ctx.create_app(f, n_app_conn_xs, right_list_cons);
-        auto n_cons = ctx.create_global(f, ctx.custom_functions.at("f__Cons")->function, ctx.create_i32(2));
+        auto n_cons = ctx.create_global_ref(f, *ctx.get_custom_function("f__Cons"));
         auto n_app_cons = ctx.create_app(f, n_cons, n_x);
         ctx.create_enablegc(f);
         ctx.create_push(f, ctx.create_app(f, n_app_cons, n_app_conn)); // gc issue?
@@ -206,81 +312,46 @@ void instruction_binop::gen_llvm(llvm_context& ctx, Function* f) const {
         ctx.create_pack(f, ctx.create_size(0),  // See comments below
                     ctx.builder.CreateSelect(ctx.builder.CreateICmpNE(result, ctx.create_i8(0)),  // result i8/i32 -> i1
                             ctx.create_i8(1), ctx.create_i8(0)));
-    } else if (op == PLUS || op == MINUS || op == TIMES || op == DIVIDE) {
+    } else if (binop_is_num(op) && kind != NUM_INT) {
         auto left_value = ctx.create_pop(f);
         auto right_value = ctx.create_pop(f);
-        auto left_tag = ctx.get_node_tag(left_value);
-        auto right_tag = ctx.get_node_tag(right_value);
+        if (kind == NUM_FLOAT) {
+            push_num_result(ctx, f, op, create_float_binop(ctx, op,
+                    ctx.unwrap_num_as_float(left_value), ctx.unwrap_num_as_float(right_value)), true);
+            return;
+        }
 
-        auto is_left_float = ctx.builder.CreateICmpEQ(left_tag, ctx.create_i32(2));  // (enum) Tag == 2 -> float
-        auto is_right_float = ctx.builder.CreateICmpEQ(right_tag, ctx.create_i32(2));
+        // Generic: any float operand makes it a float operation. Only the taken branch allocates.
+        auto is_left_float = ctx.builder.CreateICmpEQ(ctx.get_node_tag(left_value), ctx.create_i32(2));  // (enum) Tag == 2 -> float
+        auto is_right_float = ctx.builder.CreateICmpEQ(ctx.get_node_tag(right_value), ctx.create_i32(2));
         auto is_any_float = ctx.builder.CreateOr(is_left_float, is_right_float);
 
-        auto left_num = ctx.unwrap_num(left_value);
-        auto right_num = ctx.unwrap_num(right_value);
-        auto left_float = ctx.unwrap_float(left_value);
-        auto right_float = ctx.unwrap_float(right_value);
-
-        auto left_as_float = ctx.builder.CreateSelect(is_left_float,
-                left_float, ctx.builder.CreateSIToFP(left_num, llvm::Type::getFloatTy(ctx.ctx)));
-        auto right_as_float = ctx.builder.CreateSelect(is_right_float,
-                right_float, ctx.builder.CreateSIToFP(right_num, llvm::Type::getFloatTy(ctx.ctx)));
-
-        llvm::Value* num_result;
-        llvm::Value* float_result;
-        switch (op) {
-            case PLUS:
-                float_result = ctx.builder.CreateFAdd(left_as_float, right_as_float);
-                num_result = ctx.builder.CreateAdd(left_num, right_num);
-                break;
-            case MINUS:
-                float_result = ctx.builder.CreateFSub(left_as_float, right_as_float);
-                num_result = ctx.builder.CreateSub(left_num, right_num);
-                break;
-            case TIMES:
-                float_result = ctx.builder.CreateFMul(left_as_float, right_as_float);
-                num_result = ctx.builder.CreateMul(left_num, right_num);
-                break;
-            case DIVIDE:
-                float_result = ctx.builder.CreateFDiv(left_as_float, right_as_float);
-                num_result = ctx.builder.CreateSDiv(left_num, right_num);
-                break;
-        }
+        auto safety_block = BasicBlock::Create(ctx.ctx, "safety", f);
+        auto float_block = BasicBlock::Create(ctx.ctx, "floatBlock", f);
+        auto int_block = BasicBlock::Create(ctx.ctx, "intBlock", f);
+        ctx.builder.CreateCondBr(is_any_float, float_block, int_block);
+
+        ctx.builder.SetInsertPoint(float_block);
+        push_num_result(ctx, f, op, create_float_binop(ctx, op,
+                ctx.unwrap_num_as_float(left_value), ctx.unwrap_num_as_float(right_value)), true);
+        ctx.builder.CreateBr(safety_block);
+
+        ctx.builder.SetInsertPoint(int_block);
+        push_num_result(ctx, f, op, create_int_binop(ctx, op,
+                ctx.unwrap_num(left_value), ctx.unwrap_num(right_value)), false);
+        ctx.builder.CreateBr(safety_block);
 
-        ctx.create_push(f, ctx.builder.CreateSelect(is_any_float,
-                ctx.create_float(f, float_result), ctx.create_num(f, num_result)));
+        ctx.builder.SetInsertPoint(safety_block);
     } else {
         auto left_int = ctx.unwrap_num(ctx.create_pop(f));
         auto right_int = ctx.unwrap_num(ctx.create_pop(f));
-        llvm::Value* result;
-        switch(op) {
-            case BMOD: result = ctx.builder.CreateSRem(left_int, right_int); break;
-            case LMOVE: result = ctx.builder.CreateShl(left_int, right_int); break;
-            case RMOVE: result = ctx.builder.CreateAShr(left_int, right_int); break;
-            case BITAND: result = ctx.builder.CreateAnd(left_int, right_int); break;
-            case BITOR: result = ctx.builder.CreateOr(left_int, right_int); break;
-            case XOR: result = ctx.builder.CreateXor(left_int, right_int); break;
-            case LT: result = ctx.builder.CreateICmpSLT(left_int, right_int); break;
-            case GT: result = ctx.builder.CreateICmpSGT(left_int, right_int); break;
-            case LEQ: result = ctx.builder.CreateICmpSLE(left_int, right_int); break;
-            case GEQ: result = ctx.builder.CreateICmpSGE(left_int, right_int); break;
-            case EQ: result = ctx.builder.CreateICmpEQ(left_int, right_int); break;
-            case NEQ: result = ctx.builder.CreateICmpNE(left_int, right_int); break;
-        }
-        if (op == LT || op == GT || op == LEQ || op == GEQ || op == EQ || op == NEQ) {
-            // For (num -> (num -> (Bool*))) operations, we need to simulate a Data constructor here.
-            // See instruction.cpp - void instruction_pack::gen_llvm and definition.cpp - void definition_data::generate_llvm.
-            ctx.create_pack(f, ctx.create_size(0),  // The constructor takes 0 elements in the stack (or, arity = 0).
-                    ctx.builder.CreateSelect(result, ctx.create_i8(1), ctx.create_i8(0)));  // The constructor-tag is 1 (True) or 0 (False), depanded on result.
-        } else {
-            ctx.create_push(f, ctx.create_num(f, result));
-        }
+        push_num_result(ctx, f, op, create_int_binop(ctx, op, left_int, right_int), false);
     }
 }
 
 void instruction_uniop::print(int indent, std::ostream& to) const {
     print_indent(indent, to);
-    to << "UniOp(" << uniop_name(op) << ")" << std::endl;
+    to << "UniOp(" << uniop_name(op) << num_kind_suffix(kind) << ")" << std::endl;
 }
 
 void instruction_uniop::gen_llvm(llvm_context& ctx, Function* f) const {
@@ -293,12 +364,27 @@ void instruction_uniop::gen_llvm(llvm_context& ctx, Function* f) const {
         auto int_value = ctx.unwrap_num(ctx.create_pop(f));
         auto result = ctx.builder.CreateNot(int_value);
         ctx.create_push(f, ctx.create_num(f, result));
-    } else {  // op == NEGATE
+    } else if (kind == NUM_INT) {  // op == NEGATE
+        ctx.create_push(f, ctx.create_num(f, ctx.builder.CreateNeg(ctx.unwrap_num(ctx.create_pop(f)))));
+    } else if (kind == NUM_FLOAT) {
+        ctx.create_push(f, ctx.create_float(f, ctx.builder.CreateFNeg(ctx.unwrap_num_as_float(ctx.create_pop(f)))));
+    } else {
         auto value = ctx.create_pop(f);
-        ctx.create_push(f, ctx.builder.CreateSelect(
-                ctx.builder.CreateICmpEQ(ctx.get_node_tag(value), ctx.create_i32(2)),  // is_float
-                        ctx.create_float(f, ctx.builder.CreateFNeg(ctx.unwrap_float(value))),
-                        ctx.create_num(f, ctx.builder.CreateNeg(ctx.unwrap_num(value)))));
+        auto safety_block = BasicBlock::Create(ctx.ctx, "safety", f);
+        auto float_block = BasicBlock::Create(ctx.ctx, "floatBlock", f);
+        auto int_block = BasicBlock::Create(ctx.ctx, "intBlock", f);
+        ctx.builder.CreateCondBr(ctx.builder.CreateICmpEQ(ctx.get_node_tag(value), ctx.create_i32(2)),  // is_float
+                float_block, int_block);
+
+        ctx.builder.SetInsertPoint(float_block);
+        ctx.create_push(f, ctx.create_float(f, ctx.builder.CreateFNeg(ctx.unwrap_float(value))));
+        ctx.builder.CreateBr(safety_block);
+
+        ctx.builder.SetInsertPoint(int_block);
+        ctx.create_push(f, ctx.create_num(f, ctx.builder.CreateNeg(ctx.unwrap_num(value))));
+        ctx.builder.CreateBr(safety_block);
+
+        ctx.builder.SetInsertPoint(safety_block);
     }
 }
 
@@ -320,6 +406,33 @@ void instruction_alloc::gen_llvm(llvm_context& ctx, Function* f) const {
     ctx.create_alloc(f, ctx.create_size(amount));
 }
 
+void instruction_selfcall::print(int indent, std::ostream& to) const {
+    print_indent(indent, to);
+    to << "SelfCall(" << arity << ", " << depth << ")" << std::endl;
+}
+
+void instruction_selfcall::gen_llvm(llvm_context& ctx, Function* f) const {
+    // The new arguments overwrite the current frame, then we jump back to the body.
+    // See definition.cpp - void definition_defn::generate_llvm for the block layout.
+    ctx.create_slide_args(f, ctx.create_size(arity), ctx.create_size(depth));
+    ctx.builder.CreateBr(f->getEntryBlock().getSingleSuccessor());
+    ctx.builder.SetInsertPoint(BasicBlock::Create(ctx.ctx, "dead", f));
+}
+
+void instruction_tailcall::print(int indent, std::ostream& to) const {
+    print_indent(indent, to);
+    to << "TailCall(" << name << ", " << arity << ", " << depth << ")" << std::endl;
+}
+
+void instruction_tailcall::gen_llvm(llvm_context& ctx, Function* f) const {
+    // The callee finds its arguments right above our root and updates the root itself.
+    ctx.create_slide_args(f, ctx.create_size(arity), ctx.create_size(depth));
+    auto call = ctx.builder.CreateCall(ctx.get_custom_function("f_" + name)->function, { f->arg_begin() });
+    call->setTailCallKind(CallInst::TCK_MustTail);
+    ctx.builder.CreateRetVoid();
+    ctx.builder.SetInsertPoint(BasicBlock::Create(ctx.ctx, "dead", f));
+}
+
 void instruction_unwind::print(int indent, std::ostream& to) const {
     print_indent(indent, to);
     to << "Unwind()" << std::endl;
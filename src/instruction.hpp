@@ -19,9 +19,9 @@ struct instruction {
 using instruction_ptr = std::unique_ptr<instruction>;
 
 struct instruction_pushint : public instruction {
-    int value;
+    int64_t value;
 
-    instruction_pushint(int v)
+    instruction_pushint(int64_t v)
         : value(v) {}
 
     void print(int indent, std::ostream& to) const;
@@ -29,9 +29,9 @@ struct instruction_pushint : public instruction {
 };
 
 struct instruction_pushfloat : public instruction {
-    float value;
+    double value;
 
-    instruction_pushfloat(float v)
+    instruction_pushfloat(double v)
         : value(v) {}
 
     void print(int indent, std::ostream& to) const;
@@ -48,6 +48,29 @@ struct instruction_pushchar : public instruction {
     void gen_llvm(llvm_context& ctx, llvm::Function* f) const;
 };
 
+// A value known entirely at compile time: a number, a character or a list of literals.
+struct literal {
+    enum literal_kind { INT, FLOAT, CHAR, LIST } kind;
+    int64_t int_value = 0;
+    double float_value = 0;
+    char char_value = 0;
+    std::vector<literal> elements;
+    int8_t nil_tag = 0;
+    int8_t cons_tag = 0;
+
+    void print(std::ostream& to) const;
+};
+
+struct instruction_pushliteral : public instruction {
+    literal value;
+
+    instruction_pushliteral(literal v)
+        : value(std::move(v)) {}
+
+    void print(int indent, std::ostream& to) const;
+    void gen_llvm(llvm_context& ctx, llvm::Function* f) const;
+};
+
 struct instruction_pushglobal : public instruction {
     std::string name;
 
@@ -58,6 +81,17 @@ struct instruction_pushglobal : public instruction {
     void gen_llvm(llvm_context& ctx, llvm::Function* f) const;
 };
 
+struct instruction_pushapp : public instruction {
+    std::string name;
+    int count;
+
+    instruction_pushapp(std::string n, int c)
+        : name(std::move(n)), count(c) {}
+
+    void print(int indent, std::ostream& to) const;
+    void gen_llvm(llvm_context& ctx, llvm::Function* f) const;
+};
+
 struct instruction_push : public instruction {
     int offset;
 
@@ -134,9 +168,10 @@ struct instruction_slide : public instruction {
 
 struct instruction_binop : public instruction {
     binop op;
+    num_kind kind;
 
-    instruction_binop(binop o)
-        : op(o) {}
+    instruction_binop(binop o, num_kind k = NUM_GENERIC)
+        : op(o), kind(k) {}
 
     void print(int indent, std::ostream& to) const;
     void gen_llvm(llvm_context& ctx, llvm::Function* f) const;
@@ -144,9 +179,10 @@ struct instruction_binop : public instruction {
 
 struct instruction_uniop : public instruction {
     uniop op;
+    num_kind kind;
 
-    instruction_uniop(uniop o)
-        : op(o) {}
+    instruction_uniop(uniop o, num_kind k = NUM_GENERIC)
+        : op(o), kind(k) {}
 
     void print(int indent, std::ostream& to) const;
     void gen_llvm(llvm_context& ctx, llvm::Function* f) const;
@@ -167,6 +203,29 @@ struct instruction_alloc : public instruction {
     void gen_llvm(llvm_context& ctx, llvm::Function* f) const;
 };
 
+struct instruction_selfcall : public instruction {
+    int arity;
+    int depth;
+
+    instruction_selfcall(int a, int d)
+        : arity(a), depth(d) {}
+
+    void print(int indent, std::ostream& to) const;
+    void gen_llvm(llvm_context& ctx, llvm::Function* f) const;
+};
+
+struct instruction_tailcall : public instruction {
+    std::string name;
+    int arity;
+    int depth;
+
+    instruction_tailcall(std::string n, int a, int d)
+        : name(std::move(n)), arity(a), depth(d) {}
+
+    void print(int indent, std::ostream& to) const;
+    void gen_llvm(llvm_context& ctx, llvm::Function* f) const;
+};
+
 struct instruction_unwind : public instruction {
     void print(int indent, std::ostream& to) const;
     void gen_llvm(llvm_context& ctx, llvm::Function* f) const;
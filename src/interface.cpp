@@ -0,0 +1,201 @@
+#include "interface.hpp"
+#include "ast.hpp"
+#include "error.hpp"
+#include <fstream>
+
+/*
+    Interfaces are text, one entry per line:
+
+        module Name
+        import Other
+        data Type vars
+        constructor Type Name tag arity scheme
+        defn name arity caf scheme
+
+    A scheme is the number of quantified variables, each as its name and whether it
+    is a Num variable, followed by the type in prefix form: ?var, a type's name,
+    "-> left right", or "@ count constructor arguments...".
+*/
+
+static type_error malformed(const std::string& path) {
+    return type_error("Malformed module interface " + path + ".");
+}
+
+static void write_type(const type_ptr& t, const std::set<std::string>& quantified, std::ostream& to) {
+    switch(t->kind) {
+        case TYPE_VAR: {
+            type_var* var = static_cast<type_var*>(t.get());
+            if(quantified.count(var->name)) {
+                to << " ?" << var->name;
+            } else if(var->num_type) {
+                // The specializer compiles Num variables that were never generalized as Int.
+                to << " Int";
+            } else {
+                throw unexpected_error("write_interface: free type variable " + var->name);
+            }
+            break;
+        }
+        case TYPE_BASE:
+        case TYPE_DATA:
+            to << " " << static_cast<type_base*>(t.get())->name;
+            break;
+        case TYPE_ARR: {
+            type_arr* arr = static_cast<type_arr*>(t.get());
+            to << " ->";
+            write_type(arr->left, quantified, to);
+            write_type(arr->right, quantified, to);
+            break;
+        }
+        case TYPE_APP: {
+            type_app* app = static_cast<type_app*>(t.get());
+            to << " @ " << app->arguments.size();
+            write_type(app->constructor, quantified, to);
+            for(auto& argument : app->arguments) write_type(argument, quantified, to);
+            break;
+        }
+    }
+}
+
+static void write_scheme(const type_mgr& mgr, const type_env_ptr& env,
+        const std::string& name, std::ostream& to) {
+    type_scheme_ptr scheme = env->lookup(name);
+    std::set<std::string> quantified;
+    to << " " << scheme->forall.size();
+    for(auto& var : scheme->forall) {
+        to << " " << var.first << " " << var.second;
+        quantified.insert(var.first);
+    }
+    write_type(mgr.expand(scheme->monotype), quantified, to);
+    to << "\n";
+}
+
+static type_ptr read_type(std::istream& from, const type_env_ptr& env,
+        const std::map<std::string, type_ptr>& vars, const std::string& path) {
+    std::string word;
+    if(!(from >> word)) throw malformed(path);
+
+    if(word == "->") {
+        type_ptr left = read_type(from, env, vars, path);
+        type_ptr right = read_type(from, env, vars, path);
+        return type_ptr(new type_arr(std::move(left), std::move(right)));
+    }
+    if(word == "@") {
+        size_t count;
+        if(!(from >> count)) throw malformed(path);
+        type_app* app = new type_app(read_type(from, env, vars, path));
+        type_ptr result(app);
+        for(size_t i = 0; i < count; i++) app->arguments.push_back(read_type(from, env, vars, path));
+        return result;
+    }
+    if(word[0] == '?') {
+        auto var = vars.find(word.substr(1));
+        if(var == vars.end()) throw malformed(path);
+        return var->second;
+    }
+    type_ptr named = env->lookup_type(word);
+    if(!named) throw type_error("Unknown type " + word + " in module interface " + path + ".");
+    return named;
+}
+
+static type_scheme_ptr read_scheme(std::istream& from, const type_env_ptr& env, const std::string& path) {
+    size_t count;
+    if(!(from >> count)) throw malformed(path);
+    std::vector<std::pair<std::string, bool>> forall;
+    std::map<std::string, type_ptr> vars;
+    for(size_t i = 0; i < count; i++) {
+        std::string name;
+        bool num;
+        if(!(from >> name >> num)) throw malformed(path);
+        type_var* var = new type_var(name);
+        if(num) var->set_num_type();
+        vars[name] = type_ptr(var);
+        forall.emplace_back(name, num);
+    }
+
+    type_scheme_ptr scheme(new type_scheme(read_type(from, env, vars, path)));
+    scheme->forall = std::move(forall);
+    return scheme;
+}
+
+void load_interface(const std::string& module, type_env_ptr& env, imported_modules& into) {
+    if(!into.modules.insert(module).second) return;
+
+    std::string path = module + ".fi";
+    std::ifstream file(path);
+    if(!file.is_open()) throw type_error("Cannot open the interface " + path + " of module " + module + ".");
+
+    auto bind_name = [&](const std::string& name, type_scheme_ptr scheme) {
+        auto existing = into.names.find(name);
+        if(existing != into.names.end())
+            throw type_error(name + " is defined by both module " + existing->second + " and module " + module + ".");
+        into.names[name] = module;
+        env->bind(name, std::move(scheme));
+    };
+
+    std::string entry;
+    while(file >> entry) {
+        if(entry == "module") {
+            std::string name;
+            if(!(file >> name) || name != module) throw malformed(path);
+        } else if(entry == "import") {
+            std::string name;
+            if(!(file >> name)) throw malformed(path);
+            load_interface(name, env, into);
+        } else if(entry == "data") {
+            std::string name;
+            int32_t vars;
+            if(!(file >> name >> vars)) throw malformed(path);
+            env->bind_type(name, type_ptr(new type_data(name, vars)));
+            into.types[name] = module;
+        } else if(entry == "constructor") {
+            std::string type_name, name;
+            int tag;
+            int32_t arity;
+            if(!(file >> type_name >> name >> tag >> arity)) throw malformed(path);
+            auto type = into.types.find(type_name);
+            if(type == into.types.end() || type->second != module) throw malformed(path);
+            static_cast<type_data*>(env->lookup_type(type_name).get())->constructors[name] = { tag };
+            bind_name(name, read_scheme(file, env, path));
+            into.globals["f_" + name] = { arity, true };
+        } else if(entry == "defn") {
+            std::string name;
+            int32_t arity;
+            bool caf;
+            if(!(file >> name >> arity >> caf)) throw malformed(path);
+            bind_name(name, read_scheme(file, env, path));
+            into.globals["f_" + name] = { arity, caf };
+        } else {
+            throw malformed(path);
+        }
+    }
+}
+
+void write_interface(const std::string& module, const std::vector<std::string>& imports,
+        const std::map<std::string, definition_data_ptr>& defs_data,
+        const std::set<std::string>& own_data,
+        const std::map<std::string, definition_defn_ptr>& defs_defn,
+        const type_mgr& mgr, const type_env_ptr& env) {
+    std::string path = module + ".fi";
+    std::ofstream file(path, std::ios::out | std::ios::trunc);
+    if(!file.is_open()) throw unexpected_error("Cannot write the interface " + path + ".");
+
+    file << "module " << module << "\n";
+    for(auto& name : imports) file << "import " << name << "\n";
+
+    // Every data type comes before the constructors, whose types may refer to any of them.
+    for(auto& name : own_data) {
+        file << "data " << name << " " << defs_data.at(name)->vars.size() << "\n";
+    }
+    for(auto& name : own_data) {
+        for(auto& constructor : defs_data.at(name)->constructors) {
+            file << "constructor " << name << " " << constructor->name << " "
+                << (int) constructor->tag << " " << constructor->types.size();
+            write_scheme(mgr, env, constructor->name, file);
+        }
+    }
+    for(auto& def_defn : defs_defn) {
+        auto& def = *def_defn.second;
+        file << "defn " << def.name << " " << def.params.size() << " " << def.caf;
+        write_scheme(mgr, env, def.name, file);
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "definition.hpp"
+#include "llvm_context.hpp"
+#include "type.hpp"
+#include "type_env.hpp"
+
+/*
+    A module compiled with --module=Name is described to the programs and modules
+    importing it by Name.fi, written next to Name.o. The interface lists the modules
+    it imports, its data types with their constructors' tags and arities, and the
+    arity, sharing and generalized type of each definition, which is all an importer
+    needs to be type checked and generated without the module's source.
+*/
+struct imported_modules {
+    std::set<std::string> modules;
+    // The module each imported data type, constructor and definition comes from.
+    std::map<std::string, std::string> types;
+    std::map<std::string, std::string> names;
+    // The globals the modules' object files define, by function name.
+    std::map<std::string, llvm_context::external_global> globals;
+};
+
+// Binds the data types and names of module, and of the modules it imports, in env.
+// The data types the interfaces refer to, like Bool and List, must be bound already.
+void load_interface(const std::string& module, type_env_ptr& env, imported_modules& into);
+
+// Writes module.fi for the data types in own_data and every definition, once they are type checked.
+void write_interface(const std::string& module, const std::vector<std::string>& imports,
+        const std::map<std::string, definition_data_ptr>& defs_data,
+        const std::set<std::string>& own_data,
+        const std::map<std::string, definition_defn_ptr>& defs_defn,
+        const type_mgr& mgr, const type_env_ptr& env);
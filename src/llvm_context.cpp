@@ -1,5 +1,8 @@
 #include "llvm_context.hpp"
+#include "instruction.hpp"
 #include <llvm/IR/DerivedTypes.h>
+#include <llvm/Transforms/Utils/ModuleUtils.h>
+#include <stdexcept>
 
 using namespace llvm;
 
@@ -9,6 +12,8 @@ void llvm_context::create_types() {
     stack_ptr_type = PointerType::getUnqual(stack_type);
     gmachine_ptr_type = PointerType::getUnqual(gmachine_type);
     tag_type = IntegerType::getInt8Ty(ctx);
+    int_value_type = IntegerType::get(ctx, wide_numbers ? 64 : 32);
+    float_value_type = wide_numbers ? Type::getDoubleTy(ctx) : Type::getFloatTy(ctx);
     struct_types["node_base"] = StructType::create(ctx, "node_base");
     struct_types["node_app"] = StructType::create(ctx, "node_app");
     struct_types["node_num"] = StructType::create(ctx, "node_num");
@@ -16,14 +21,23 @@ void llvm_context::create_types() {
     struct_types["node_global"] = StructType::create(ctx, "node_global");
     struct_types["node_ind"] = StructType::create(ctx, "node_ind");
     struct_types["node_data"] = StructType::create(ctx, "node_data");
+    struct_types["node_array"] = StructType::create(ctx, "node_array");
+    struct_types["node_int_array"] = StructType::create(ctx, "node_int_array");
+    struct_types["node_float_array"] = StructType::create(ctx, "node_float_array");
     node_ptr_type = PointerType::getUnqual(struct_types.at("node_base"));
     function_type = FunctionType::get(Type::getVoidTy(ctx), { gmachine_ptr_type }, false);
 
+    stack_type->setBody(
+            IntegerType::get(ctx, sizeof(size_t) * 8),
+            IntegerType::get(ctx, sizeof(size_t) * 8),
+            PointerType::getUnqual(node_ptr_type)
+    );
     gmachine_type->setBody(
-            stack_ptr_type,
+            stack_type,
             node_ptr_type,
             IntegerType::getInt64Ty(ctx),
-            IntegerType::getInt64Ty(ctx)
+            IntegerType::getInt64Ty(ctx),
+            IntegerType::getInt8Ty(ctx)
     );
     struct_types.at("node_base")->setBody(
             IntegerType::getInt32Ty(ctx),
@@ -37,15 +51,16 @@ void llvm_context::create_types() {
     );
     struct_types.at("node_num")->setBody(
             struct_types.at("node_base"),
-            IntegerType::getInt32Ty(ctx)
+            int_value_type
     );
     struct_types.at("node_float")->setBody(
             struct_types.at("node_base"),
-            Type::getFloatTy(ctx)
+            float_value_type
     );
     struct_types.at("node_global")->setBody(
             struct_types.at("node_base"),
-            FunctionType::get(Type::getVoidTy(ctx), { stack_ptr_type }, false)
+            IntegerType::getInt32Ty(ctx),
+            PointerType::getUnqual(function_type)
     );
     struct_types.at("node_ind")->setBody(
             struct_types.at("node_base"),
@@ -56,6 +71,21 @@ void llvm_context::create_types() {
             IntegerType::getInt8Ty(ctx),
             PointerType::getUnqual(node_ptr_type)
     );
+    struct_types.at("node_array")->setBody(
+            struct_types.at("node_base"),
+            IntegerType::getInt32Ty(ctx),
+            ArrayType::get(node_ptr_type, 0)
+    );
+    struct_types.at("node_int_array")->setBody(
+            struct_types.at("node_base"),
+            IntegerType::getInt32Ty(ctx),
+            ArrayType::get(int_value_type, 0)
+    );
+    struct_types.at("node_float_array")->setBody(
+            struct_types.at("node_base"),
+            IntegerType::getInt32Ty(ctx),
+            ArrayType::get(float_value_type, 0)
+    );
 }
 
 void llvm_context::create_functions() {
@@ -103,6 +133,12 @@ void llvm_context::create_functions() {
             "gmachine_slide",
             &module
     );
+    functions["gmachine_slide_args"] = Function::Create(
+            FunctionType::get(void_type, { gmachine_ptr_type, sizet_type, sizet_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "gmachine_slide_args",
+            &module
+    );
     functions["gmachine_update"] = Function::Create(
             FunctionType::get(void_type, { gmachine_ptr_type, sizet_type }, false),
             Function::LinkageTypes::ExternalLinkage,
@@ -147,7 +183,6 @@ void llvm_context::create_functions() {
     );
 
     auto int32_type = IntegerType::getInt32Ty(ctx);
-    auto float32_type = llvm::Type::getFloatTy(ctx);
     functions["alloc_app"] = Function::Create(
             FunctionType::get(node_ptr_type, { node_ptr_type, node_ptr_type }, false),
             Function::LinkageTypes::ExternalLinkage,
@@ -155,13 +190,13 @@ void llvm_context::create_functions() {
             &module
     );
     functions["alloc_num"] = Function::Create(
-            FunctionType::get(node_ptr_type, { int32_type }, false),
+            FunctionType::get(node_ptr_type, { int_value_type }, false),
             Function::LinkageTypes::ExternalLinkage,
             "alloc_num",
             &module
     );
     functions["alloc_float"] = Function::Create(
-            FunctionType::get(node_ptr_type, { float32_type }, false),
+            FunctionType::get(node_ptr_type, { float_value_type }, false),
             Function::LinkageTypes::ExternalLinkage,
             "alloc_float",
             &module
@@ -173,7 +208,7 @@ void llvm_context::create_functions() {
             &module
     );
     functions["alloc_global"] = Function::Create(
-            FunctionType::get(node_ptr_type, { function_type, int32_type }, false),
+            FunctionType::get(node_ptr_type, { PointerType::getUnqual(function_type), int32_type }, false),
             Function::LinkageTypes::ExternalLinkage,
             "alloc_global",
             &module
@@ -185,12 +220,196 @@ void llvm_context::create_functions() {
             &module
     );
 
-    functions["unwind"] = Function::Create(
+    functions["gmachine_array"] = Function::Create(
+            FunctionType::get(void_type, { gmachine_ptr_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "gmachine_array",
+            &module
+    );
+    functions["gmachine_unboxed_array"] = Function::Create(
+            FunctionType::get(void_type, { gmachine_ptr_type, tag_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "gmachine_unboxed_array",
+            &module
+    );
+    functions["unboxed_array_zip"] = Function::Create(
+            FunctionType::get(node_ptr_type, { tag_type, node_ptr_type, node_ptr_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "unboxed_array_zip",
+            &module
+    );
+    functions["unboxed_array_map"] = Function::Create(
+            FunctionType::get(node_ptr_type, { tag_type, node_ptr_type, node_ptr_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "unboxed_array_map",
+            &module
+    );
+    functions["unboxed_array_fold"] = Function::Create(
+            FunctionType::get(node_ptr_type, { tag_type, node_ptr_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "unboxed_array_fold",
+            &module
+    );
+    functions["unboxed_array_dot"] = Function::Create(
+            FunctionType::get(node_ptr_type, { node_ptr_type, node_ptr_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "unboxed_array_dot",
+            &module
+    );
+    functions["unboxed_array_sort"] = Function::Create(
+            FunctionType::get(void_type, { node_ptr_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "unboxed_array_sort",
+            &module
+    );
+    functions["unboxed_array_search"] = Function::Create(
+            FunctionType::get(int32_type, { node_ptr_type, node_ptr_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "unboxed_array_search",
+            &module
+    );
+    functions["unboxed_array_partition"] = Function::Create(
+            FunctionType::get(int32_type, { node_ptr_type, node_ptr_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "unboxed_array_partition",
+            &module
+    );
+    functions["gmachine_sort"] = Function::Create(
+            FunctionType::get(void_type, { gmachine_ptr_type, node_ptr_type, node_ptr_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "gmachine_sort",
+            &module
+    );
+    functions["gmachine_search"] = Function::Create(
+            FunctionType::get(int32_type, { gmachine_ptr_type, node_ptr_type, node_ptr_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "gmachine_search",
+            &module
+    );
+    functions["gmachine_partition"] = Function::Create(
+            FunctionType::get(int32_type, { gmachine_ptr_type, node_ptr_type, node_ptr_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "gmachine_partition",
+            &module
+    );
+    functions["gmachine_print"] = Function::Create(
             FunctionType::get(void_type, { gmachine_ptr_type }, false),
             Function::LinkageTypes::ExternalLinkage,
-            "unwind",
+            "gmachine_print",
             &module
     );
+    functions["output_flush"] = Function::Create(
+            FunctionType::get(void_type, {}, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "output_flush",
+            &module
+    );
+    functions["output_int"] = Function::Create(
+            FunctionType::get(void_type, { int_value_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "output_int",
+            &module
+    );
+    functions["output_float"] = Function::Create(
+            FunctionType::get(void_type, { float_value_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "output_float",
+            &module
+    );
+    functions["input_char"] = Function::Create(
+            FunctionType::get(int32_type, {}, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "input_char",
+            &module
+    );
+    functions["read_int"] = Function::Create(
+            FunctionType::get(node_ptr_type, {}, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "read_int",
+            &module
+    );
+    functions["read_float"] = Function::Create(
+            FunctionType::get(node_ptr_type, {}, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "read_float",
+            &module
+    );
+    functions["gmachine_read_line"] = Function::Create(
+            FunctionType::get(node_ptr_type, { gmachine_ptr_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "gmachine_read_line",
+            &module
+    );
+    functions["gmachine_read_word"] = Function::Create(
+            FunctionType::get(node_ptr_type, { gmachine_ptr_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "gmachine_read_word",
+            &module
+    );
+    functions["gmachine_vector"] = Function::Create(
+            FunctionType::get(void_type, { gmachine_ptr_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "gmachine_vector",
+            &module
+    );
+    functions["vector_get"] = Function::Create(
+            FunctionType::get(node_ptr_type, { node_ptr_type, int_value_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "vector_get",
+            &module
+    );
+    functions["gmachine_vector_set"] = Function::Create(
+            FunctionType::get(node_ptr_type, { gmachine_ptr_type, node_ptr_type, int_value_type, node_ptr_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "gmachine_vector_set",
+            &module
+    );
+    functions["gmachine_vector_push"] = Function::Create(
+            FunctionType::get(node_ptr_type, { gmachine_ptr_type, node_ptr_type, node_ptr_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "gmachine_vector_push",
+            &module
+    );
+    functions["gmachine_vector_replicate"] = Function::Create(
+            FunctionType::get(node_ptr_type, { gmachine_ptr_type, int_value_type, node_ptr_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "gmachine_vector_replicate",
+            &module
+    );
+    functions["array_bounds_error"] = Function::Create(
+            FunctionType::get(void_type, { int_value_type, int32_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "array_bounds_error",
+            &module
+    );
+    functions["array_bounds_error"]->setDoesNotReturn();
+    functions["gc_register_root"] = Function::Create(
+            FunctionType::get(void_type, { node_ptr_type }, false),
+            Function::LinkageTypes::ExternalLinkage,
+            "gc_register_root",
+            &module
+    );
+
+    // Defined in the module itself by generate_eval, once every global is known.
+    functions["eval"] = Function::Create(
+            function_type,
+            Function::LinkageTypes::InternalLinkage,
+            "eval",
+            &module
+    );
+}
+
+/*
+    The runtime defines only the symbol matching the widths it was built
+    with, so linking against a runtime built without -DWIDE_NUMBERS (or
+    with it, for a narrow program) fails instead of misreading nodes.
+*/
+void llvm_context::create_number_width_check(const std::string& name) {
+    auto flag_type = IntegerType::getInt8Ty(ctx);
+    auto flag = new GlobalVariable(module, flag_type, true, GlobalValue::ExternalLinkage,
+            nullptr, wide_numbers ? "runtime_wide_numbers" : "runtime_narrow_numbers");
+    new GlobalVariable(module, PointerType::getUnqual(flag_type), true, GlobalValue::ExternalLinkage,
+            flag, name);
 }
 
 ConstantInt* llvm_context::create_i8(int8_t i) {
@@ -203,8 +422,12 @@ ConstantInt* llvm_context::create_size(size_t i) {
     return ConstantInt::get(ctx, APInt(sizeof(size_t) * 8, i));
 }
 
-ConstantFP* llvm_context::create_f32(float_t f) {
-    return ConstantFP::get(ctx, APFloat(f));
+ConstantInt* llvm_context::create_int_value(int64_t i) {
+    return ConstantInt::get(int_value_type, i, true);
+}
+
+Constant* llvm_context::create_float_value(double f) {
+    return ConstantFP::get(float_value_type, f);
 }
 
 Value* llvm_context::create_pop(Function* f) {
@@ -235,10 +458,22 @@ void llvm_context::create_split(Function* f, Value* c) {
     auto split_f = functions.at("gmachine_split");
     builder.CreateCall(split_f, { f->arg_begin(), c });
 }
+void llvm_context::create_array(Function* f) {
+    auto array_f = functions.at("gmachine_array");
+    builder.CreateCall(array_f, { f->arg_begin() });
+}
+void llvm_context::create_unboxed_array(Function* f, bool is_float) {
+    auto array_f = functions.at("gmachine_unboxed_array");
+    builder.CreateCall(array_f, { f->arg_begin(), create_i8(is_float) });
+}
 void llvm_context::create_slide(Function* f, Value* off) {
     auto slide_f = functions.at("gmachine_slide");
     builder.CreateCall(slide_f, { f->arg_begin(), off });
 }
+void llvm_context::create_slide_args(Function* f, Value* n, Value* off) {
+    auto slide_args_f = functions.at("gmachine_slide_args");
+    builder.CreateCall(slide_args_f, { f->arg_begin(), n, off });
+}
 void llvm_context::create_alloc(Function* f, Value* n) {
     auto alloc_f = functions.at("gmachine_alloc");
     builder.CreateCall(alloc_f, { f->arg_begin(), n });
@@ -258,8 +493,126 @@ Value *llvm_context::create_track(Function *f, Value *v)
 }
 
 void llvm_context::create_unwind(Function* f) {
-    auto unwind_f = functions.at("unwind");
-    builder.CreateCall(unwind_f, { f->args().begin() });
+    // Nodes already in WHNF are the common case; only call eval for APP, GLOBAL and IND.
+    auto eval_f = functions.at("eval");
+    auto call_block = BasicBlock::Create(ctx, "unwind", f);
+    auto done_block = BasicBlock::Create(ctx, "unwound", f);
+    auto tag = get_node_tag(create_stack_top(unwrap_gmachine_stack_ptr(f->arg_begin())));
+    auto tag_switch = builder.CreateSwitch(tag, done_block, 3);
+    tag_switch->addCase(create_i32(0), call_block);  // NODE_APP
+    tag_switch->addCase(create_i32(3), call_block);  // NODE_GLOBAL
+    tag_switch->addCase(create_i32(4), call_block);  // NODE_IND
+    builder.SetInsertPoint(call_block);
+    builder.CreateCall(eval_f, { f->arg_begin() });
+    builder.CreateBr(done_block);
+    builder.SetInsertPoint(done_block);
+}
+
+Value* llvm_context::create_stack_top_ptr(Value* s, int32_t off) {
+    auto offset_0 = create_i32(0);
+    auto count = builder.CreateLoad(builder.CreateGEP(s, { offset_0, create_i32(1) }));
+    auto data = builder.CreateLoad(builder.CreateGEP(s, { offset_0, create_i32(2) }));
+    auto index = builder.CreateSub(count, create_size(off + 1));
+    return builder.CreateGEP(node_ptr_type, data, index);
+}
+Value* llvm_context::create_stack_top(Value* s) {
+    return builder.CreateLoad(create_stack_top_ptr(s, 0));
+}
+
+void llvm_context::generate_eval() {
+    /*
+        The same loop as unwind in runtime.c, but visible to LLVM:
+        the tag dispatch is inlined, and argument rearrangement is
+        unrolled for every arity a known global can have.
+    */
+    auto f = functions.at("eval");
+    auto g = f->arg_begin();
+    auto entry_block = BasicBlock::Create(ctx, "entry", f);
+    auto loop_block = BasicBlock::Create(ctx, "loop", f);
+    auto app_block = BasicBlock::Create(ctx, "app", f);
+    auto ind_block = BasicBlock::Create(ctx, "ind", f);
+    auto global_block = BasicBlock::Create(ctx, "global", f);
+    auto generic_block = BasicBlock::Create(ctx, "generic", f);
+    auto generic_loop_block = BasicBlock::Create(ctx, "generic_loop", f);
+    auto call_block = BasicBlock::Create(ctx, "call", f);
+    auto done_block = BasicBlock::Create(ctx, "done", f);
+
+    builder.SetInsertPoint(entry_block);
+    auto s = unwrap_gmachine_stack_ptr(g);
+    builder.CreateBr(loop_block);
+
+    builder.SetInsertPoint(loop_block);
+    auto top_ptr = create_stack_top_ptr(s, 0);
+    auto top = builder.CreateLoad(top_ptr);
+    auto tag_switch = builder.CreateSwitch(get_node_tag(top), done_block, 3);
+    tag_switch->addCase(create_i32(0), app_block);  // NODE_APP
+    tag_switch->addCase(create_i32(3), global_block);  // NODE_GLOBAL
+    tag_switch->addCase(create_i32(4), ind_block);  // NODE_IND
+
+    auto offset_0 = create_i32(0);
+    auto offset_1 = create_i32(1);
+    auto offset_2 = create_i32(2);
+    auto app_ptr_type = PointerType::getUnqual(struct_types.at("node_app"));
+
+    builder.SetInsertPoint(app_block);
+    auto app = builder.CreatePointerCast(top, app_ptr_type);
+    Value* left = builder.CreateLoad(builder.CreateGEP(app, { offset_0, offset_1 }));
+    builder.CreateCall(functions.at("stack_push"), { s, left });
+    builder.CreateBr(loop_block);
+
+    builder.SetInsertPoint(ind_block);
+    auto ind = builder.CreatePointerCast(top, PointerType::getUnqual(struct_types.at("node_ind")));
+    builder.CreateStore(builder.CreateLoad(builder.CreateGEP(ind, { offset_0, offset_1 })), top_ptr);
+    builder.CreateBr(loop_block);
+
+    builder.SetInsertPoint(global_block);
+    auto global = builder.CreatePointerCast(top, PointerType::getUnqual(struct_types.at("node_global")));
+    auto arity = builder.CreateLoad(builder.CreateGEP(global, { offset_0, offset_1 }));
+    auto function = builder.CreateLoad(builder.CreateGEP(global, { offset_0, offset_2 }));
+    int32_t max_arity = 0;
+    for(auto& custom_f : custom_functions) {
+        max_arity = std::max(max_arity, custom_f.second->arity);
+    }
+    auto arity_switch = builder.CreateSwitch(arity, generic_block, max_arity + 1);
+    arity_switch->addCase(create_i32(0), call_block);
+    for(int32_t a = 1; a <= max_arity; a++) {
+        auto arity_block = BasicBlock::Create(ctx, "arity_" + std::to_string(a), f, generic_block);
+        arity_switch->addCase(create_i32(a), arity_block);
+        builder.SetInsertPoint(arity_block);
+        // data[count - i] = data[count - i - 1]->right, for i = 1..arity.
+        for(int32_t i = 0; i < a; i++) {
+            auto spine = builder.CreatePointerCast(
+                    builder.CreateLoad(create_stack_top_ptr(s, i + 1)), app_ptr_type);
+            auto right = builder.CreateLoad(builder.CreateGEP(spine, { offset_0, offset_2 }));
+            builder.CreateStore(right, create_stack_top_ptr(s, i));
+        }
+        builder.CreateBr(call_block);
+    }
+
+    // Globals built at runtime from unknown arities fall back to a plain loop.
+    builder.SetInsertPoint(generic_block);
+    auto arity_size = builder.CreateZExt(arity, IntegerType::get(ctx, sizeof(size_t) * 8));
+    auto count = builder.CreateLoad(builder.CreateGEP(s, { offset_0, offset_1 }));
+    auto data = builder.CreateLoad(builder.CreateGEP(s, { offset_0, offset_2 }));
+    builder.CreateBr(generic_loop_block);
+    builder.SetInsertPoint(generic_loop_block);
+    auto i = builder.CreatePHI(arity_size->getType(), 2);
+    i->addIncoming(create_size(1), generic_block);
+    auto dest_ptr = builder.CreateGEP(node_ptr_type, data, builder.CreateSub(count, i));
+    auto src_ptr = builder.CreateGEP(node_ptr_type, data,
+            builder.CreateSub(count, builder.CreateAdd(i, create_size(1))));
+    auto spine = builder.CreatePointerCast(builder.CreateLoad(src_ptr), app_ptr_type);
+    builder.CreateStore(builder.CreateLoad(builder.CreateGEP(spine, { offset_0, offset_2 })), dest_ptr);
+    auto next_i = builder.CreateAdd(i, create_size(1));
+    i->addIncoming(next_i, generic_loop_block);
+    builder.CreateCondBr(builder.CreateICmpULE(next_i, arity_size), generic_loop_block, call_block);
+
+    builder.SetInsertPoint(call_block);
+    builder.CreateCall(function_type, function, { g });
+    builder.CreateBr(loop_block);
+
+    builder.SetInsertPoint(done_block);
+    builder.CreateRetVoid();
 }
 
 Value* llvm_context::unwrap_gmachine_stack_ptr(Value* g) {
@@ -278,15 +631,22 @@ Value* llvm_context::unwrap_num(Value* v) {
 Value* llvm_context::unwrap_float(Value* v) {
     auto float_ptr_type = PointerType::getUnqual(struct_types.at("node_float"));
     auto cast = builder.CreatePointerCast(v, float_ptr_type);
-    auto offset_0 = create_i32(0);  // Not "create_f32(0)" here.
+    auto offset_0 = create_i32(0);  // Not "create_float_value(0)" here.
     auto offset_1 = create_i32(1);
     auto float_ptr = builder.CreateGEP(cast, { offset_0, offset_1 });
     return builder.CreateLoad(float_ptr);
 }
 
+Value* llvm_context::unwrap_num_as_float(Value* v) {
+    auto is_float = builder.CreateICmpEQ(get_node_tag(v), create_i32(2));  // (enum) Tag == 2 -> float
+    return builder.CreateSelect(is_float, unwrap_float(v),
+            builder.CreateSIToFP(unwrap_num(v), float_value_type));
+}
+
 Value* llvm_context::create_num(Function* f, Value* v) {
+    // Lengths and indices are i32, so they are widened to Int here.
     auto alloc_num_f = functions.at("alloc_num");
-    auto alloc_num_call = builder.CreateCall(alloc_num_f, { v });
+    auto alloc_num_call = builder.CreateCall(alloc_num_f, { builder.CreateSExtOrTrunc(v, int_value_type) });
     return create_track(f, alloc_num_call);
 }
 Value* llvm_context::create_float(Function* f, Value* v) {
@@ -316,27 +676,43 @@ Value* llvm_context::get_node_tag(Value* node_ptr) {
     return builder.CreateLoad(tag_ptr);
 }
 
-llvm::Value *llvm_context::access_array(Value *v, Value *index) {
-    auto data_ptr_type = PointerType::getUnqual(struct_types.at("node_data"));
-    auto cast = builder.CreatePointerCast(v, data_ptr_type);
-    auto offset_0 = create_i32(0);
-    auto offset_1 = create_i32(2);
-    auto array_ptr = builder.CreateGEP(cast, { offset_0, offset_1 });
-    auto real_array_ptr = builder.CreateLoad(array_ptr);
+Value* llvm_context::unwrap_array_length(Value* v) {
+    auto array_ptr_type = PointerType::getUnqual(struct_types.at("node_array"));
+    auto cast = builder.CreatePointerCast(v, array_ptr_type);
+    auto length_ptr = builder.CreateGEP(cast, { create_i32(0), create_i32(1) });
+    return builder.CreateLoad(length_ptr);
+}
+
+Value* llvm_context::create_array_element_ptr(Function* f, StructType* array_type, Value* v, Value* index) {
+    // Every array node keeps its length in field 1 and its elements inline in field 2.
+    auto array_ptr_type = PointerType::getUnqual(array_type);
+    auto cast = builder.CreatePointerCast(v, array_ptr_type);
     auto index_num = unwrap_num(index);
-    auto element_ptr = builder.CreateGEP(node_ptr_type, real_array_ptr, index_num);
+
+    if(bounds_checks) {
+        // A single unsigned comparison also rejects negative indices.
+        Value* length = builder.CreateZExt(unwrap_array_length(v), int_value_type);
+        auto error_block = BasicBlock::Create(ctx, "outOfBounds", f);
+        auto ok_block = BasicBlock::Create(ctx, "inBounds", f);
+        builder.CreateCondBr(builder.CreateICmpULT(index_num, length), ok_block, error_block);
+
+        builder.SetInsertPoint(error_block);
+        builder.CreateCall(functions.at("array_bounds_error"), { index_num, unwrap_array_length(v) });
+        builder.CreateUnreachable();
+
+        builder.SetInsertPoint(ok_block);
+    }
+
+    return builder.CreateGEP(cast, { create_i32(0), create_i32(2), index_num });
+}
+
+Value* llvm_context::access_array(Function* f, Value* v, Value* index) {
+    Value* element_ptr = create_array_element_ptr(f, struct_types.at("node_array"), v, index);
     return builder.CreateLoad(element_ptr);
 }
 
-void llvm_context::modify_array(Value *v, llvm::Value *index, Value *operand) {
-    auto data_ptr_type = PointerType::getUnqual(struct_types.at("node_data"));
-    auto cast = builder.CreatePointerCast(v, data_ptr_type);
-    auto offset_0 = create_i32(0);
-    auto offset_1 = create_i32(2);
-    auto array_ptr = builder.CreateGEP(cast, { offset_0, offset_1 });
-    auto real_array_ptr = builder.CreateLoad(array_ptr);
-    auto index_num = unwrap_num(index);
-    auto element_ptr = builder.CreateGEP(node_ptr_type, real_array_ptr, index_num);
+void llvm_context::modify_array(Function* f, Value* v, Value* index, Value* operand) {
+    Value* element_ptr = create_array_element_ptr(f, struct_types.at("node_array"), v, index);
     builder.CreateStore(operand, element_ptr);
 }
 
@@ -346,13 +722,85 @@ Value* llvm_context::create_global(Function* f, Value* gf, Value* a) {
     return create_track(f, alloc_global_call);
 }
 
+Value* llvm_context::create_global_ref(Function* f, const custom_function& global_f) {
+    if(global_f.node) return builder.CreatePointerCast(global_f.node, node_ptr_type);
+    return create_global(f, global_f.function, create_i32(global_f.arity));
+}
+
 Value* llvm_context::create_app(Function* f, Value* l, Value* r) {
     auto alloc_app_f = functions.at("alloc_app");
     auto alloc_app_call = builder.CreateCall(alloc_app_f, { l, r });
     return create_track(f, alloc_app_call);
 }
 
-llvm::Function* llvm_context::create_custom_function(std::string name, int32_t arity) {
+/*
+    Literals become constant nodes in read-only data. Like the nodes of functions,
+    they are marked reachable from the start, so the collector neither frees nor
+    traverses them, and everything they point to is a literal node as well.
+*/
+Constant* llvm_context::create_literal(const literal& l) {
+    auto base = [&](int32_t tag) {
+        return ConstantStruct::get(struct_types.at("node_base"), {
+                create_i32(tag), create_i8(1), ConstantPointerNull::get(node_ptr_type) });
+    };
+
+    StructType* node_type;
+    Constant* initializer;
+    switch(l.kind) {
+        case literal::INT:
+            node_type = struct_types.at("node_num");
+            initializer = ConstantStruct::get(node_type, { base(1), create_int_value(l.int_value) }); // NODE_NUM
+            break;
+        case literal::FLOAT:
+            node_type = struct_types.at("node_float");
+            initializer = ConstantStruct::get(node_type, { base(2), create_float_value(l.float_value) }); // NODE_FLOAT
+            break;
+        case literal::CHAR:
+            return create_literal_data(l.char_value, {});
+        case literal::LIST: {
+            // Evaluated cons cells, laid out as gmachine_pack would: { tail, head }.
+            Constant* list = create_literal_data(l.nil_tag, {});
+            for(auto it = l.elements.rbegin(); it != l.elements.rend(); it++) {
+                list = create_literal_data(l.cons_tag, { list, create_literal(*it) });
+            }
+            return list;
+        }
+    }
+
+    auto node = new GlobalVariable(module, node_type, true,
+            GlobalValue::LinkageTypes::PrivateLinkage, initializer, "literal");
+    return ConstantExpr::getPointerCast(node, node_ptr_type);
+}
+
+Constant* llvm_context::create_literal_data(int8_t tag, std::vector<Constant*> fields) {
+    // Characters and empty lists carry no fields, so one node per tag is enough.
+    if(fields.empty() && literal_data.count(tag)) return literal_data.at(tag);
+
+    auto array_ptr_type = PointerType::getUnqual(node_ptr_type);
+    fields.push_back(ConstantPointerNull::get(node_ptr_type));
+    auto array_type = ArrayType::get(node_ptr_type, fields.size());
+    auto array = new GlobalVariable(module, array_type, true,
+            GlobalValue::LinkageTypes::PrivateLinkage, ConstantArray::get(array_type, fields), "literal_array");
+
+    auto node_type = struct_types.at("node_data");
+    auto initializer = ConstantStruct::get(node_type, {
+            ConstantStruct::get(struct_types.at("node_base"), {
+                create_i32(5), // NODE_DATA
+                create_i8(1),
+                ConstantPointerNull::get(node_ptr_type)
+            }),
+            create_i8(tag),
+            ConstantExpr::getPointerCast(array, array_ptr_type)
+    });
+    auto node = new GlobalVariable(module, node_type, true,
+            GlobalValue::LinkageTypes::PrivateLinkage, initializer, "literal");
+    auto result = ConstantExpr::getPointerCast(node, node_ptr_type);
+
+    if(fields.size() == 1) literal_data[tag] = result;
+    return result;
+}
+
+llvm::Function* llvm_context::create_custom_function(std::string name, int32_t arity, bool shared) {
     auto void_type = llvm::Type::getVoidTy(ctx);
     auto new_function = llvm::Function::Create(
             function_type,
@@ -365,7 +813,76 @@ llvm::Function* llvm_context::create_custom_function(std::string name, int32_t a
     auto new_custom_f = custom_function_ptr(new custom_function());
     new_custom_f->arity = arity;
     new_custom_f->function = new_function;
+
+    /*
+        Functions never change once allocated, so one constant node serves every push.
+        It is marked reachable for good, which keeps the collector from writing to it.
+        A shared CAF node is writable instead: its first evaluation turns it into an
+        indirection to the result, and it is registered as a GC root by generate_caf_roots.
+        Other CAFs (IO actions) get a fresh node on every push.
+    */
+    if(arity > 0 || shared) {
+        auto node_type = struct_types.at("node_global");
+        auto initializer = ConstantStruct::get(node_type, {
+                ConstantStruct::get(struct_types.at("node_base"), {
+                    create_i32(3), // NODE_GLOBAL
+                    create_i8(arity > 0),
+                    ConstantPointerNull::get(node_ptr_type)
+                }),
+                create_i32(arity),
+                new_function
+        });
+        new_custom_f->node = new GlobalVariable(module, node_type, arity > 0,
+                export_nodes ? GlobalValue::LinkageTypes::ExternalLinkage : GlobalValue::LinkageTypes::InternalLinkage,
+                initializer, "n_" + name);
+        if(arity == 0) caf_nodes.push_back(new_custom_f->node);
+    }
+
     custom_functions["f_" + name] = std::move(new_custom_f);
 
     return new_function;
 }
+
+void llvm_context::declare_custom_function(std::string name, int32_t arity, bool shared) {
+    auto new_custom_f = custom_function_ptr(new custom_function());
+    new_custom_f->arity = arity;
+    new_custom_f->function = Function::Create(
+            function_type, Function::LinkageTypes::ExternalLinkage, "f_" + name, &module);
+    // The defining module registers a shared CAF node as a root.
+    if(arity > 0 || shared) {
+        new_custom_f->node = new GlobalVariable(module, struct_types.at("node_global"), arity > 0,
+                GlobalValue::LinkageTypes::ExternalLinkage, nullptr, "n_" + name);
+    }
+    custom_functions["f_" + name] = std::move(new_custom_f);
+}
+
+llvm_context::custom_function_ptr& llvm_context::get_custom_function(const std::string& name) {
+    auto it = custom_functions.find(name);
+    if(it != custom_functions.end()) return it->second;
+    if(external_globals) {
+        auto global = external_globals->find(name);
+        if(global != external_globals->end()) {
+            declare_custom_function(name.substr(2), global->second.arity, global->second.shared);
+            return custom_functions.at(name);
+        }
+    }
+    throw std::out_of_range("llvm_context::get_custom_function: " + name);
+}
+
+void llvm_context::generate_caf_roots() {
+    // Shared CAF nodes live outside the heap but may point into it once updated,
+    // so the collector has to know about them before main runs.
+    if(caf_nodes.empty()) return;
+    auto f = Function::Create(
+            FunctionType::get(Type::getVoidTy(ctx), false),
+            Function::LinkageTypes::InternalLinkage,
+            "register_caf_roots",
+            &module
+    );
+    builder.SetInsertPoint(BasicBlock::Create(ctx, "entry", f));
+    for(auto node : caf_nodes) {
+        builder.CreateCall(functions.at("gc_register_root"), { builder.CreatePointerCast(node, node_ptr_type) });
+    }
+    builder.CreateRetVoid();
+    appendToGlobalCtors(module, f, 65535);
+}
@@ -1,20 +1,32 @@
 #pragma once
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Value.h>
 #include <map>
+#include <vector>
+
+struct literal;
 
 struct llvm_context {
     struct custom_function {
         llvm::Function* function;
         int32_t arity;
+        // The module-level node pushed for this global, or nullptr if every push allocates one.
+        llvm::GlobalVariable* node = nullptr;
     };
 
     using custom_function_ptr = std::unique_ptr<custom_function>;
 
+    // A global defined by another module of the same program.
+    struct external_global {
+        int32_t arity;
+        bool shared;
+    };
+
     llvm::LLVMContext ctx;
     llvm::IRBuilder<> builder;
     llvm::Module module;
@@ -22,6 +34,8 @@ struct llvm_context {
     std::map<std::string, custom_function_ptr> custom_functions;
     std::map<std::string, llvm::Function*> functions;
     std::map<std::string, llvm::StructType*> struct_types;
+    std::vector<llvm::GlobalVariable*> caf_nodes;
+    std::map<int8_t, llvm::Constant*> literal_data;
 
     llvm::StructType* stack_type;
     llvm::StructType* gmachine_type;
@@ -29,21 +43,36 @@ struct llvm_context {
     llvm::PointerType* gmachine_ptr_type;
     llvm::PointerType* node_ptr_type;
     llvm::IntegerType* tag_type;
+    llvm::IntegerType* int_value_type;
+    llvm::Type* float_value_type;
     llvm::FunctionType* function_type;
 
-    llvm_context()
-        : builder(ctx), module("FuncCompiler", ctx) {
+    // Whether array accesses check their index against the length.
+    bool bounds_checks = true;
+    // Whether Int is i64 and Float is double, rather than i32 and float.
+    bool wide_numbers;
+    // Set when the program is split over several modules: the nodes of globals are
+    // then visible to the other modules, which refer to them through declare_custom_function.
+    bool export_nodes = false;
+    // The globals of the other modules by function name, declared the first time they are used.
+    const std::map<std::string, external_global>* external_globals = nullptr;
+
+    llvm_context(bool wide = false)
+        : builder(ctx), module("FuncCompiler", ctx), wide_numbers(wide) {
         create_types();
         create_functions();
     }
 
     void create_types();
     void create_functions();
+    // Each object file of a program needs its own symbol name for the check.
+    void create_number_width_check(const std::string& name = "number_width_check");
 
     llvm::ConstantInt* create_i8(int8_t);
     llvm::ConstantInt* create_i32(int32_t);
     llvm::ConstantInt* create_size(size_t);
-    llvm::ConstantFP* create_f32(float_t);
+    llvm::ConstantInt* create_int_value(int64_t);
+    llvm::Constant* create_float_value(double);
 
     llvm::Value* create_pop(llvm::Function*);
     llvm::Value* create_peek(llvm::Function*, llvm::Value*);
@@ -52,18 +81,25 @@ struct llvm_context {
     void create_update(llvm::Function*, llvm::Value*);
     void create_pack(llvm::Function*, llvm::Value*, llvm::Value*);
     void create_split(llvm::Function*, llvm::Value*);
+    void create_array(llvm::Function*);
+    void create_unboxed_array(llvm::Function*, bool);
     void create_slide(llvm::Function*, llvm::Value*);
+    void create_slide_args(llvm::Function*, llvm::Value*, llvm::Value*);
     void create_alloc(llvm::Function*, llvm::Value*);
     void create_enablegc(llvm::Function*);
     void create_disablegc(llvm::Function*);
     llvm::Value* create_track(llvm::Function*, llvm::Value*);
 
     void create_unwind(llvm::Function*);
+    llvm::Value* create_stack_top_ptr(llvm::Value*, int32_t);
+    llvm::Value* create_stack_top(llvm::Value*);
+    void generate_eval();
 
     llvm::Value* unwrap_gmachine_stack_ptr(llvm::Value*);
 
     llvm::Value* unwrap_num(llvm::Value*);
     llvm::Value* unwrap_float(llvm::Value*);
+    llvm::Value* unwrap_num_as_float(llvm::Value*);
     llvm::Value* create_num(llvm::Function*, llvm::Value*);
     llvm::Value* create_float(llvm::Function*, llvm::Value*);
     llvm::Value* create_data(llvm::Function*, llvm::Value*, llvm::Value*);
@@ -71,12 +107,22 @@ struct llvm_context {
     llvm::Value* unwrap_data_tag(llvm::Value*);
     llvm::Value* get_node_tag(llvm::Value*);
 
-    llvm::Value* access_array(llvm::Value*, llvm::Value*);
-    void modify_array(llvm::Value*, llvm::Value*, llvm::Value*);
+    llvm::Value* unwrap_array_length(llvm::Value*);
+    llvm::Value* create_array_element_ptr(llvm::Function*, llvm::StructType*, llvm::Value*, llvm::Value*);
+    llvm::Value* access_array(llvm::Function*, llvm::Value*, llvm::Value*);
+    void modify_array(llvm::Function*, llvm::Value*, llvm::Value*, llvm::Value*);
 
     llvm::Value* create_global(llvm::Function*, llvm::Value*, llvm::Value*);
+    llvm::Value* create_global_ref(llvm::Function*, const custom_function&);
 
     llvm::Value* create_app(llvm::Function*, llvm::Value*, llvm::Value*);
 
-    llvm::Function* create_custom_function(std::string name, int32_t arity);
+    llvm::Constant* create_literal(const literal&);
+    llvm::Constant* create_literal_data(int8_t, std::vector<llvm::Constant*>);
+
+    llvm::Function* create_custom_function(std::string name, int32_t arity, bool shared = false);
+    void declare_custom_function(std::string name, int32_t arity, bool shared);
+    // Like custom_functions.at, but declares the external globals as they are needed.
+    custom_function_ptr& get_custom_function(const std::string& name);
+    void generate_caf_roots();
 };
@@ -1,23 +1,38 @@
 #include "ast.hpp"
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <mutex>
 #include "binop.hpp"
+#include "cache.hpp"
 #include "definition.hpp"
 #include "graph.hpp"
+#include "inliner.hpp"
+#include "interface.hpp"
 #include "instruction.hpp"
+#include "peephole.hpp"
 #include "llvm_context.hpp"
+#include "options.hpp"
 #include "parser.hpp"
 #include "error.hpp"
 #include "type.hpp"
 #include "prelude.hpp"
+#include "scheduler.hpp"
+#include "specialize.hpp"
+#include "timer.hpp"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/PassTimingInfo.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Pass.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Program.h"
 #include "llvm/Target/TargetOptions.h"
 #include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
 
 extern int lexer_error_cnt;
 extern int parser_error_cnt;
@@ -30,11 +45,12 @@ void yy::parser::error(const std::string& msg) {
 
 extern std::map<std::string, definition_data_ptr> defs_data;
 extern std::map<std::string, definition_defn_ptr> defs_defn;
+extern std::vector<std::string> imports;
 
 void typecheck_program(
         std::map<std::string, definition_data_ptr>& defs_data,
         const std::map<std::string, definition_defn_ptr>& defs_defn,
-        type_mgr& mgr, type_env_ptr& env) {
+        type_mgr& mgr, type_env_ptr& env, int jobs, imported_modules& imported) {
     /*
         Insert types
     */
@@ -138,13 +154,39 @@ void typecheck_program(
     type_ptr array_type_ptr = type_ptr(array_app);
     array_app->arguments.push_back(array_arg_type);
 
+    // add vector
+    definition_data_ptr vector_data = definition_data_ptr(
+            new definition_data("Vector", std::vector<std::string>{"VectorArg"}, std::vector<constructor_ptr>()));
+    vector_data->insert_types(env);
+
+    type_ptr vector_arg_type = type_ptr(new type_var("VectorArg"));
+
+    type_app *vector_app = new type_app(type_ptr(env->lookup_type("Vector")));
+    type_ptr vector_type_ptr = type_ptr(vector_app);
+    vector_app->arguments.push_back(vector_arg_type);
+
     // insert all data definitions
     for(auto& def_data : defs_data) {
         def_data.second->insert_types(env);
     }
+    // Imported constructors and data fields may use any of the data types above.
+    for(auto& module : imports) {
+        load_interface(module, env, imported);
+    }
     for(auto& def_data : defs_data) {
         def_data.second->insert_constructors();
     }
+    auto check_not_imported = [&](const std::string& name) {
+        auto existing = imported.names.find(name);
+        if(existing != imported.names.end())
+            throw type_error(name + " is already defined by module " + existing->second + ".");
+    };
+    for(auto& def_data : defs_data) {
+        for(auto& constructor : def_data.second->constructors) check_not_imported(constructor->name);
+    }
+    for(auto& def_defn : defs_defn) {
+        check_not_imported(def_defn.first);
+    }
 
     type_ptr list_arg_type = type_ptr(new type_var("ListArg"));
     type_app *list_app = new type_app(type_ptr(env->lookup_type("List")));
@@ -224,6 +266,21 @@ void typecheck_program(
     env->bind("read", read_type);
     prelude_func.insert("read");
 
+    // readInt, readFloat, readLine, readWord, getContents
+    std::map<std::string, type_ptr> read_results = {
+        { "readInt", int_type_app },
+        { "readFloat", float_type_app },
+        { "readLine", string_type },
+        { "readWord", string_type },
+        { "getContents", string_type },
+    };
+    for(auto& reader : read_results) {
+        type_app *io_result_app = new type_app(type_ptr(env->lookup_type("IO")));
+        io_result_app->arguments.push_back(reader.second);
+        env->bind(reader.first, type_ptr(io_result_app));
+        prelude_func.insert(reader.first);
+    }
+
     // print
     type_ptr io_empty_type = mgr.new_type();
     mgr.unify(type_ptr(new type_arr(empty_type_app, io_empty_type)), io_bind_scheme_ptr->instantiate(mgr));
@@ -231,6 +288,12 @@ void typecheck_program(
     env->bind("print", print_type);
     prelude_func.insert("print");
 
+    // printInt, printFloat
+    env->bind("printInt", type_ptr(new type_arr(int_type_app, io_empty_type)));
+    prelude_func.insert("printInt");
+    env->bind("printFloat", type_ptr(new type_arr(float_type_app, io_empty_type)));
+    prelude_func.insert("printFloat");
+
     // charToNum
     type_ptr charToNum_type = type_ptr(new type_arr(char_type_app, num_type_app));
     type_scheme_ptr charToNum_type_ptr = type_scheme_ptr(new type_scheme(std::move(charToNum_type)));
@@ -297,6 +360,113 @@ void typecheck_program(
     env->bind("modify", modify_type_ptr);
     prelude_func.insert("modify");
 
+    // vector, vectorSize, vectorGet, vectorSet, vectorPush, vectorReplicate
+    type_app *vector_list_app = new type_app(type_ptr(env->lookup_type("List")));
+    type_ptr vector_list_type = type_ptr(vector_list_app);
+    vector_list_app->arguments.push_back(vector_arg_type);
+
+    std::map<std::string, type_ptr> vector_funcs = {
+        { "vector", type_ptr(new type_arr(vector_list_type, vector_type_ptr)) },
+        { "vectorSize", type_ptr(new type_arr(vector_type_ptr, int_type_app)) },
+        { "vectorGet", type_ptr(new type_arr(vector_type_ptr,
+                type_ptr(new type_arr(int_type_app, vector_arg_type)))) },
+        { "vectorSet", type_ptr(new type_arr(vector_type_ptr, type_ptr(new type_arr(int_type_app,
+                type_ptr(new type_arr(vector_arg_type, vector_type_ptr)))))) },
+        { "vectorPush", type_ptr(new type_arr(vector_type_ptr,
+                type_ptr(new type_arr(vector_arg_type, vector_type_ptr)))) },
+        { "vectorReplicate", type_ptr(new type_arr(int_type_app,
+                type_ptr(new type_arr(vector_arg_type, vector_type_ptr)))) },
+    };
+    for(auto& func : vector_funcs) {
+        type_scheme_ptr func_type_ptr = type_scheme_ptr(new type_scheme(func.second));
+        func_type_ptr->forall.emplace_back("VectorArg", false);
+        env->bind(func.first, func_type_ptr);
+        prelude_func.insert(func.first);
+    }
+
+    // sort, sortByKey, search, partition
+    type_app *num_array_app = new type_app(type_ptr(env->lookup_type("Array")));
+    type_ptr num_array_type = type_ptr(num_array_app);
+    num_array_app->arguments.push_back(num_type_app);
+    type_app *io_num_array_app = new type_app(type_ptr(env->lookup_type("IO")));
+    type_ptr io_num_array_type = type_ptr(io_num_array_app);
+    io_num_array_app->arguments.push_back(num_array_type);
+    type_app *io_int_app = new type_app(type_ptr(env->lookup_type("IO")));
+    type_ptr io_int_type = type_ptr(io_int_app);
+    io_int_app->arguments.push_back(int_type_app);
+
+    type_ptr sort_type = type_ptr(new type_arr(num_array_type, io_num_array_type));
+    type_scheme_ptr sort_type_ptr = type_scheme_ptr(new type_scheme(std::move(sort_type)));
+    sort_type_ptr->forall.emplace_back("Num", true);
+    env->bind("sort", sort_type_ptr);
+    prelude_func.insert("sort");
+
+    type_ptr sort_by_key_right = type_ptr(new type_arr(array_type_ptr, io_array_type));
+    type_ptr sort_by_key_type = type_ptr(new type_arr(
+            type_ptr(new type_arr(array_arg_type, num_type_app)), sort_by_key_right));
+    type_scheme_ptr sort_by_key_type_ptr = type_scheme_ptr(new type_scheme(std::move(sort_by_key_type)));
+    sort_by_key_type_ptr->forall.emplace_back("ArrayArg", false);
+    sort_by_key_type_ptr->forall.emplace_back("Num", true);
+    env->bind("sortByKey", sort_by_key_type_ptr);
+    prelude_func.insert("sortByKey");
+
+    type_ptr search_type = type_ptr(new type_arr(num_array_type,
+            type_ptr(new type_arr(num_type_app, int_type_app))));
+    type_scheme_ptr search_type_ptr = type_scheme_ptr(new type_scheme(std::move(search_type)));
+    search_type_ptr->forall.emplace_back("Num", true);
+    env->bind("search", search_type_ptr);
+    prelude_func.insert("search");
+
+    type_ptr partition_type = type_ptr(new type_arr(num_array_type,
+            type_ptr(new type_arr(num_type_app, io_int_type))));
+    type_scheme_ptr partition_type_ptr = type_scheme_ptr(new type_scheme(std::move(partition_type)));
+    partition_type_ptr->forall.emplace_back("Num", true);
+    env->bind("partition", partition_type_ptr);
+    prelude_func.insert("partition");
+
+    // unboxed arrays: intArray, intAccess, ..., floatDot
+    for(bool is_float : { false, true }) {
+        std::string prefix = is_float ? "float" : "int";
+        std::string type_name = is_float ? "FloatArray" : "IntArray";
+        type_ptr element_type = is_float ? float_type_app : int_type_app;
+
+        type_ptr unboxed_type = type_ptr(new type_base(type_name));
+        env->bind_type(type_name, unboxed_type);
+        type_ptr unboxed_type_app = type_ptr(new type_app(unboxed_type));
+
+        type_app *element_list_app = new type_app(type_ptr(env->lookup_type("List")));
+        type_ptr element_list_type = type_ptr(element_list_app);
+        element_list_app->arguments.push_back(element_type);
+
+        type_app *io_unboxed_app = new type_app(type_ptr(env->lookup_type("IO")));
+        type_ptr io_unboxed_type = type_ptr(io_unboxed_app);
+        io_unboxed_app->arguments.push_back(unboxed_type_app);
+
+        auto arr = [](type_ptr l, type_ptr r) { return type_ptr(new type_arr(std::move(l), std::move(r))); };
+        std::map<std::string, type_ptr> unboxed_funcs = {
+            { "Array", arr(element_list_type, unboxed_type_app) },
+            { "Size", arr(unboxed_type_app, int_type_app) },
+            { "Access", arr(unboxed_type_app, arr(int_type_app, element_type)) },
+            { "Modify", arr(unboxed_type_app, arr(int_type_app, arr(element_type, io_unboxed_type))) },
+            { "Add", arr(unboxed_type_app, arr(unboxed_type_app, unboxed_type_app)) },
+            { "Sub", arr(unboxed_type_app, arr(unboxed_type_app, unboxed_type_app)) },
+            { "Mul", arr(unboxed_type_app, arr(unboxed_type_app, unboxed_type_app)) },
+            { "Offset", arr(unboxed_type_app, arr(element_type, unboxed_type_app)) },
+            { "Scale", arr(unboxed_type_app, arr(element_type, unboxed_type_app)) },
+            { "Sum", arr(unboxed_type_app, element_type) },
+            { "Minimum", arr(unboxed_type_app, element_type) },
+            { "Maximum", arr(unboxed_type_app, element_type) },
+            { "Dot", arr(unboxed_type_app, arr(unboxed_type_app, element_type)) },
+            { "Sort", arr(unboxed_type_app, io_unboxed_type) },
+            { "Search", arr(unboxed_type_app, arr(element_type, int_type_app)) },
+            { "Partition", arr(unboxed_type_app, arr(element_type, io_int_type)) },
+        };
+        for(auto& func : unboxed_funcs) {
+            env->bind(prefix + func.first, func.second);
+            prelude_func.insert(prefix + func.first);
+        }
+    }
+
     function_graph dependency_graph;
 
     for(auto& def_defn : defs_defn) {
@@ -305,7 +475,8 @@ void typecheck_program(
 
         for(auto& dependency : def_defn.second->free_variables) {
             if(defs_defn.find(dependency) == defs_defn.end()) {
-                if (prelude_func.find(dependency) == prelude_func.end()) {
+                if (prelude_func.find(dependency) == prelude_func.end() &&
+                        imported.names.find(dependency) == imported.names.end()) {
                     throw type_error("defs_defn cannot find dependency: " + dependency);
                 } else {
                     continue;
@@ -316,30 +487,88 @@ void typecheck_program(
     }
 
     std::vector<group_ptr> groups = dependency_graph.compute_order();
-    for(auto it = groups.rbegin(); it != groups.rend(); it++) {
-        auto& group = *it;
-        for(auto& def_defnn_name : group->members) {
-            auto& def_defn = defs_defn.find(def_defnn_name)->second;
-            def_defn->insert_types(mgr);
-        }
-        for(auto& def_defnn_name : group->members) {
+    auto typecheck_group = [&](const group& group, type_mgr& mgr) {
+        for(auto& def_defnn_name : group.members) {
             auto& def_defn = defs_defn.find(def_defnn_name)->second;
             def_defn->typecheck(mgr);
         }
-        for(auto& def_defnn_name : group->members) {
+        for(auto& def_defnn_name : group.members) {
             env->generalize(def_defnn_name, mgr);
+            defs_defn.find(def_defnn_name)->second->mark_caf(mgr);
+        }
+    };
+
+    if(jobs <= 1) {
+        for(auto it = groups.rbegin(); it != groups.rend(); it++) {
+            for(auto& def_defnn_name : (*it)->members) {
+                defs_defn.find(def_defnn_name)->second->insert_types(mgr);
+            }
+            typecheck_group(**it, mgr);
+        }
+        return;
+    }
+
+    /*
+        Independent groups are checked in parallel. Every name is bound before
+        the threads start, so the environment's maps are only read from then on,
+        and the bindings are expanded so that no thread unifies a variable that
+        another thread can reach: each one only binds the variables of its own
+        group and the fresh ones it instantiates.
+    */
+    std::map<std::string, size_t> group_of;
+    for(size_t i = 0; i < groups.size(); i++) {
+        for(auto& def_defnn_name : groups[i]->members) {
+            group_of[def_defnn_name] = i;
+            defs_defn.find(def_defnn_name)->second->insert_types(mgr);
         }
     }
+    env->expand(mgr);
+
+    std::vector<std::vector<size_t>> dependencies(groups.size());
+    for(size_t i = 0; i < groups.size(); i++) {
+        std::set<size_t> callees;
+        for(auto& def_defnn_name : groups[i]->members) {
+            for(auto& dependency : defs_defn.find(def_defnn_name)->second->free_variables) {
+                auto callee = group_of.find(dependency);
+                if(callee != group_of.end() && callee->second != i) callees.insert(callee->second);
+            }
+        }
+        dependencies[i].assign(callees.begin(), callees.end());
+    }
+
+    std::vector<type_mgr> forks;
+    for(int worker = 1; worker < jobs; worker++) forks.push_back(mgr.fork());
+    run_dag(dependencies, jobs, [&](size_t index, int worker) {
+        typecheck_group(*groups[index], worker == 0 ? mgr : forks[worker - 1]);
+    });
 }
 
 void compile_program(const std::map<std::string, definition_defn_ptr>& defs_defn) {
+    function_graph dependency_graph;
+
     for(auto& def_defn : defs_defn) {
-        def_defn.second->compile();
+        dependency_graph.add_function(def_defn.second->name);
+        for(auto& dependency : def_defn.second->free_variables) {
+            if(defs_defn.find(dependency) == defs_defn.end()) continue;
+            dependency_graph.add_edge(def_defn.second->name, dependency);
+        }
+    }
+
+    // Tail calls may only jump within a recursion group, so compile group by group.
+    std::vector<group_ptr> groups = dependency_graph.compute_order();
+    for(auto& group : groups) {
+        std::map<std::string, int> arities;
+        for(auto& def_defnn_name : group->members) {
+            arities[def_defnn_name] = defs_defn.find(def_defnn_name)->second->params.size();
+        }
+        for(auto& def_defnn_name : group->members) {
+            defs_defn.find(def_defnn_name)->second->compile(arities);
+        }
     }
 }
 
-void gen_llvm_internal_binop(llvm_context& ctx, binop op) {
-    auto new_function = ctx.create_custom_function(binop_action(op), 2);
+void gen_llvm_internal_binop(llvm_context& ctx, binop op, num_kind kind = NUM_GENERIC) {
+    auto new_function = ctx.create_custom_function(binop_action(op, kind), 2);
     std::vector<instruction_ptr> instructions;
     instructions.push_back(instruction_ptr(new instruction_push(1)));
     if (op != CONN) {
@@ -347,7 +576,7 @@ void gen_llvm_internal_binop(llvm_context& ctx, binop op) {
     }
     instructions.push_back(instruction_ptr(new instruction_push(1)));
     instructions.push_back(instruction_ptr(new instruction_eval()));
-    instructions.push_back(instruction_ptr(new instruction_binop(op)));
+    instructions.push_back(instruction_ptr(new instruction_binop(op, kind)));
     instructions.push_back(instruction_ptr(new instruction_update(2)));
     instructions.push_back(instruction_ptr(new instruction_pop(2)));
     ctx.builder.SetInsertPoint(&new_function->getEntryBlock());
@@ -357,12 +586,12 @@ void gen_llvm_internal_binop(llvm_context& ctx, binop op) {
     ctx.builder.CreateRetVoid();
 }
 
-void gen_llvm_internal_uniop(llvm_context& ctx, uniop op) {
-    auto new_function = ctx.create_custom_function(uniop_action(op), 1);
+void gen_llvm_internal_uniop(llvm_context& ctx, uniop op, num_kind kind = NUM_GENERIC) {
+    auto new_function = ctx.create_custom_function(uniop_action(op, kind), 1);
     std::vector<instruction_ptr> instructions;
     instructions.push_back(instruction_ptr(new instruction_push(0)));
     instructions.push_back(instruction_ptr(new instruction_eval()));
-    instructions.push_back(instruction_ptr(new instruction_uniop(op)));
+    instructions.push_back(instruction_ptr(new instruction_uniop(op, kind)));
     instructions.push_back(instruction_ptr(new instruction_update(1)));
     instructions.push_back(instruction_ptr(new instruction_pop(1)));
     ctx.builder.SetInsertPoint(&new_function->getEntryBlock());
@@ -375,10 +604,6 @@ void gen_llvm_internal_uniop(llvm_context& ctx, uniop op) {
 void output_llvm(llvm_context& ctx, const std::string& filename) {
     std::string targetTriple = llvm::sys::getDefaultTargetTriple();
 
-    llvm::InitializeNativeTarget();
-    llvm::InitializeNativeTargetAsmParser();
-    llvm::InitializeNativeTargetAsmPrinter();
-
     std::string error;
     const llvm::Target* target =
         llvm::TargetRegistry::lookupTarget(targetTriple, error);
@@ -400,6 +625,20 @@ void output_llvm(llvm_context& ctx, const std::string& filename) {
         if (ec) {
             throw unexpected_error("LLVM error 1.");
         } else {
+            // Run the standard -O2 pipeline first, so eval gets inlined and specialized.
+            llvm::PassManagerBuilder pmb;
+            pmb.OptLevel = 2;
+            pmb.Inliner = llvm::createFunctionInliningPass(2, 0, false);
+            llvm::legacy::FunctionPassManager fpm(&ctx.module);
+            llvm::legacy::PassManager mpm;
+            targetMachine->adjustPassManager(pmb);
+            pmb.populateFunctionPassManager(fpm);
+            pmb.populateModulePassManager(mpm);
+            fpm.doInitialization();
+            for(auto& function : ctx.module) fpm.run(function);
+            fpm.doFinalization();
+            mpm.run(ctx.module);
+
             llvm::CodeGenFileType type = llvm::CGFT_ObjectFile;
             llvm::legacy::PassManager pm;
             if (targetMachine->addPassesToEmitFile(pm, file, NULL, type)) {
@@ -412,11 +651,8 @@ void output_llvm(llvm_context& ctx, const std::string& filename) {
     }
 }
 
-void gen_llvm(
-        const std::map<std::string, definition_data_ptr>& defs_data,
-        const std::map<std::string, definition_defn_ptr>& defs_defn) {
-    llvm_context ctx;
-
+// The functions every module of the program shares: operators, constructors and the prelude.
+void gen_llvm_builtins(llvm_context& ctx, const std::map<std::string, definition_data_ptr>& defs_data) {
     gen_llvm_internal_binop(ctx, PLUS);
     gen_llvm_internal_binop(ctx, MINUS);
     gen_llvm_internal_binop(ctx, TIMES);
@@ -440,6 +676,14 @@ void gen_llvm(
     gen_llvm_internal_uniop(ctx, NOT);
     gen_llvm_internal_uniop(ctx, BITNOT);
 
+    // Monomorphic versions for specialized code.
+    for(num_kind kind : { NUM_INT, NUM_FLOAT }) {
+        for(binop op : { PLUS, MINUS, TIMES, DIVIDE, LT, GT, LEQ, GEQ, EQ, NEQ }) {
+            gen_llvm_internal_binop(ctx, op, kind);
+        }
+        gen_llvm_internal_uniop(ctx, NEGATE, kind);
+    }
+
     for(auto& def_data : defs_data) {
         def_data.second->generate_llvm(ctx);
     }
@@ -447,7 +691,10 @@ void gen_llvm(
     gen_llvm_internal_binop(ctx, CONN);
 
     generate_read_llvm(ctx);
+    generate_readTyped_llvm(ctx);
+    generate_getContents_llvm(ctx);
     generate_print_llvm(ctx);
+    generate_printNum_llvm(ctx);
 
     generate_charToNum_llvm(ctx);
     generate_numToChar_llvm(ctx);
@@ -458,6 +705,250 @@ void gen_llvm(
     generate_size_llvm(ctx);
     generate_access_llvm(ctx);
     generate_modify_llvm(ctx);
+    generate_unboxed_array_llvm(ctx, false);
+    generate_unboxed_array_llvm(ctx, true);
+    generate_sort_llvm(ctx);
+    generate_vector_llvm(ctx);
+}
+
+// llvm_log.txt, or nullptr unless --dump-ir is given.
+std::unique_ptr<llvm::raw_fd_ostream> open_ir_log(const compiler_options& options) {
+    if (!options.dump_ir) return nullptr;
+    std::error_code EC;
+    std::unique_ptr<llvm::raw_fd_ostream> ir_log(
+            new llvm::raw_fd_ostream("llvm_log.txt", EC, llvm::sys::fs::OF_None));
+    if (EC) return nullptr;
+    return ir_log;
+}
+
+// Merges the partitions' objects into one relocatable object, so the program links as before.
+void combine_objects(const std::vector<std::string>& parts, const std::string& filename) {
+    auto ld = llvm::sys::findProgramByName("ld");
+    if (!ld) throw unexpected_error("Cannot find ld to combine the partitions.");
+    std::vector<llvm::StringRef> args = { *ld, "-r", "-o", filename };
+    for(auto& part : parts) args.push_back(part);
+    if (llvm::sys::ExecuteAndWait(*ld, args) != 0)
+        throw unexpected_error("ld failed to combine the partitions.");
+}
+
+// Every global of the program as seen from another module: the builtins in ctx, the definitions
+// and those of the imported modules.
+std::map<std::string, llvm_context::external_global> program_globals(
+        const llvm_context& ctx, const std::map<std::string, definition_defn_ptr>& defs_defn,
+        const imported_modules& imported) {
+    std::map<std::string, llvm_context::external_global> globals = imported.globals;
+    for(auto& builtin : ctx.custom_functions) {
+        globals[builtin.first] = { builtin.second->arity, builtin.second->node != nullptr };
+    }
+    for(auto& def_defn : defs_defn) {
+        globals["f_" + def_defn.second->name] = { (int32_t) def_defn.second->params.size(), def_defn.second->caf };
+    }
+    return globals;
+}
+
+/*
+    Splits the definitions over several modules, each with its own context, and
+    generates, optimizes and emits them on one thread each. The first module
+    also holds the builtins; every module declares the globals of the others it
+    uses and has its own copy of eval. Calls between modules can't be inlined, but the
+    program behaves the same as the one built from a single module.
+*/
+void gen_llvm_partitioned(
+        const std::map<std::string, definition_data_ptr>& defs_data,
+        const std::map<std::string, definition_defn_ptr>& defs_defn,
+        const compiler_options& options, const imported_modules& imported) {
+    int count = options.codegen_partitions;
+
+    // Biggest definitions first, each into the partition with the fewest instructions so far.
+    std::vector<definition_defn*> by_size;
+    for(auto& def_defn : defs_defn) by_size.push_back(def_defn.second.get());
+    std::stable_sort(by_size.begin(), by_size.end(), [](definition_defn* l, definition_defn* r) {
+        return count_instructions(l->instructions) > count_instructions(r->instructions);
+    });
+    std::vector<std::vector<definition_defn*>> partitions(count);
+    std::vector<int> sizes(count, 0);
+    for(auto def_defn : by_size) {
+        int smallest = std::min_element(sizes.begin(), sizes.end()) - sizes.begin();
+        partitions[smallest].push_back(def_defn);
+        sizes[smallest] += count_instructions(def_defn->instructions);
+    }
+
+    std::vector<std::unique_ptr<llvm_context>> contexts(count);
+    contexts[0].reset(new llvm_context(options.wide_numbers));
+    contexts[0]->bounds_checks = options.bounds_checks;
+    contexts[0]->export_nodes = true;
+    contexts[0]->create_number_width_check();
+    gen_llvm_builtins(*contexts[0], defs_data);
+
+    // Built before the threads start, since the first partition keeps adding to its context.
+    auto globals = program_globals(*contexts[0], defs_defn, imported);
+    contexts[0]->external_globals = &globals;
+
+    std::vector<std::string> parts;
+    for(int partition = 0; partition < count; partition++) {
+        parts.push_back("program." + std::to_string(partition) + ".o");
+    }
+
+    run_dag(std::vector<std::vector<size_t>>(count), count, [&](size_t partition, int worker) {
+        if(partition > 0) {
+            contexts[partition].reset(new llvm_context(options.wide_numbers));
+            contexts[partition]->bounds_checks = options.bounds_checks;
+            contexts[partition]->export_nodes = true;
+            contexts[partition]->external_globals = &globals;
+        }
+        llvm_context& ctx = *contexts[partition];
+
+        for(auto def_defn : partitions[partition]) def_defn->declare_llvm(ctx);
+        for(auto def_defn : partitions[partition]) def_defn->generate_llvm(ctx);
+
+        ctx.generate_eval();
+        ctx.generate_caf_roots();
+        output_llvm(ctx, parts[partition]);
+    });
+
+    if (auto ir_log = open_ir_log(options)) {
+        for(auto& ctx : contexts) ctx->module.print(*ir_log, nullptr);
+    }
+
+    combine_objects(parts, "program.o");
+    for(auto& part : parts) llvm::sys::fs::remove(part);
+}
+
+/*
+    Emits the builtins and every definition as separate modules, each into its
+    cache entry unless the entry is up to date, and combines the entries. Missing
+    definitions are generated on --codegen-partitions threads.
+*/
+void gen_llvm_cached(
+        const std::map<std::string, definition_data_ptr>& defs_data,
+        const std::map<std::string, definition_defn_ptr>& defs_defn,
+        const compiler_options& options, const compile_cache& cache, const imported_modules& imported) {
+    llvm::sys::fs::create_directories(cache.directory);
+
+    // The builtins are always generated, since the other modules need their arities.
+    llvm_context builtins_ctx(options.wide_numbers);
+    builtins_ctx.bounds_checks = options.bounds_checks;
+    builtins_ctx.export_nodes = true;
+    builtins_ctx.create_number_width_check();
+    gen_llvm_builtins(builtins_ctx, defs_data);
+    auto globals = program_globals(builtins_ctx, defs_defn, imported);
+
+    auto ir_log = open_ir_log(options);
+    std::mutex log_mutex;
+
+    std::vector<std::string> objects = { cache.object_path(cache.builtins_key) };
+    if (!cache.has(cache.builtins_key, "")) {
+        builtins_ctx.generate_eval();
+        builtins_ctx.generate_caf_roots();
+        if (ir_log) builtins_ctx.module.print(*ir_log, nullptr);
+        output_llvm(builtins_ctx, objects.back());
+        cache.store(cache.builtins_key, "");
+    }
+
+    std::vector<definition_defn*> missing;
+    for(auto& def_defn : defs_defn) {
+        auto& key = cache.keys.at(def_defn.first);
+        objects.push_back(cache.object_path(key));
+        if (!cache.has(key, cache.listings.at(def_defn.first))) missing.push_back(def_defn.second.get());
+    }
+
+    run_dag(std::vector<std::vector<size_t>>(missing.size()), options.codegen_partitions,
+            [&](size_t index, int worker) {
+        definition_defn* def_defn = missing[index];
+        llvm_context ctx(options.wide_numbers);
+        ctx.bounds_checks = options.bounds_checks;
+        ctx.export_nodes = true;
+        ctx.external_globals = &globals;
+        def_defn->declare_llvm(ctx);
+        def_defn->generate_llvm(ctx);
+        ctx.generate_eval();
+        ctx.generate_caf_roots();
+
+        auto& key = cache.keys.at(def_defn->name);
+        output_llvm(ctx, cache.object_path(key));
+        cache.store(key, cache.listings.at(def_defn->name));
+
+        if (ir_log) {
+            std::lock_guard<std::mutex> lock(log_mutex);
+            ctx.module.print(*ir_log, nullptr);
+        }
+    });
+
+    combine_objects(objects, "program.o");
+    if (options.time_report) {
+        std::cerr << "Reused " << defs_defn.size() - missing.size() << " of " << defs_defn.size()
+            << " definitions from " << cache.directory << "." << std::endl;
+    }
+}
+
+/*
+    Emits a module compiled with --module into Name.o. The builtins are left to
+    the program importing the module: they are only generated here to learn their
+    arities, and the module declares the ones it uses, like the globals of its own
+    imports. Its own data types' constructors are defined here.
+*/
+void gen_llvm_module(
+        const std::map<std::string, definition_data_ptr>& defs_data,
+        const std::map<std::string, definition_defn_ptr>& defs_defn,
+        const compiler_options& options, const std::set<std::string>& own_data,
+        const imported_modules& imported) {
+    llvm_context builtins_ctx(options.wide_numbers);
+    gen_llvm_builtins(builtins_ctx, defs_data);
+    auto globals = program_globals(builtins_ctx, defs_defn, imported);
+
+    llvm_context ctx(options.wide_numbers);
+    ctx.bounds_checks = options.bounds_checks;
+    ctx.export_nodes = true;
+    ctx.external_globals = &globals;
+    ctx.create_number_width_check("number_width_check_" + options.module_name);
+    for(auto& name : own_data) {
+        defs_data.at(name)->generate_llvm(ctx);
+    }
+
+    for(auto& def_defn : defs_defn) {
+        def_defn.second->declare_llvm(ctx);
+    }
+    for(auto& def_defn : defs_defn) {
+        def_defn.second->generate_llvm(ctx);
+    }
+
+    ctx.generate_eval();
+    ctx.generate_caf_roots();
+
+    if (auto ir_log = open_ir_log(options)) ctx.module.print(*ir_log, nullptr);
+
+    output_llvm(ctx, options.module_name + ".o");
+}
+
+void gen_llvm(
+        const std::map<std::string, definition_data_ptr>& defs_data,
+        const std::map<std::string, definition_defn_ptr>& defs_defn,
+        const compiler_options& options, const compile_cache* cache,
+        const std::set<std::string>& own_data, const imported_modules& imported) {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmParser();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    if (!options.module_name.empty()) {
+        gen_llvm_module(defs_data, defs_defn, options, own_data, imported);
+        return;
+    }
+    if (cache) {
+        gen_llvm_cached(defs_data, defs_defn, options, *cache, imported);
+        return;
+    }
+    if (options.codegen_partitions > 1) {
+        gen_llvm_partitioned(defs_data, defs_defn, options, imported);
+        return;
+    }
+
+    llvm_context ctx(options.wide_numbers);
+    ctx.bounds_checks = options.bounds_checks;
+    // The imported modules refer to the builtins' nodes.
+    ctx.export_nodes = !imported.modules.empty();
+    ctx.external_globals = &imported.globals;
+    ctx.create_number_width_check();
+    gen_llvm_builtins(ctx, defs_data);
 
     for(auto& def_defn : defs_defn) {
         def_defn.second->declare_llvm(ctx);
@@ -467,21 +958,30 @@ void gen_llvm(
         def_defn.second->generate_llvm(ctx);
     }
 
+    ctx.generate_eval();
+    ctx.generate_caf_roots();
+
     // ctx.module.print(log_file, nullptr);
 
-    std::error_code EC;
-    llvm::raw_fd_ostream file_stream("llvm_log.txt", EC, llvm::sys::fs::OF_None);
-    if (!EC) ctx.module.print(file_stream, nullptr);
+    if (auto ir_log = open_ir_log(options)) ctx.module.print(*ir_log, nullptr);
 
     output_llvm(ctx, "program.o");
 }
 
-int main() {
+int main(int argc, char** argv) {
+    compiler_options options;
+    if (!parse_options(argc, argv, options)) return 1;
+
     yy::parser parser;
     type_mgr mgr;
     type_env_ptr env(new type_env);
+    time_report report_data;
+    time_report* report = options.time_report ? &report_data : nullptr;
 
-    parser.parse();
+    {
+        phase_timer timer(report, "parse");
+        parser.parse();
+    }
     if (lexer_error_cnt || parser_error_cnt || uncovered_parser_error_cnt) {
         std::cout << "Parsing failed. (" <<
             lexer_error_cnt << " lexer error(s), " << 
@@ -490,40 +990,114 @@ int main() {
         return 0;
     }
 
-    std::ofstream log_file("log.txt", std::ios::out | std::ios::trunc);
-    if (!log_file.is_open()) {
-        std::cout << "Unable to open log.txt." << std::endl;
+    // The dumps are only written when asked for, since printing them is slow on big inputs.
+    std::ofstream log_file;
+    if (options.dump_ast || options.dump_types || options.dump_gcode) {
+        log_file.open("log.txt", std::ios::out | std::ios::trunc);
+        if (!log_file.is_open()) {
+            std::cout << "Unable to open log.txt." << std::endl;
+        }
     }
+    std::ostream null_log(nullptr);
+    std::ostream& pass_log = options.dump_gcode ? static_cast<std::ostream&>(log_file) : null_log;
 
-    log_file << "[AST:]\n";
-    for(auto& def_defn : defs_defn) {
-        log_file << def_defn.second->name;
-        for(auto& param : def_defn.second->params) log_file << " " << param;
-        log_file << ":\n";
-        def_defn.second->body->print(1, log_file);
+    if (options.dump_ast) {
+        log_file << "[AST:]\n";
+        for(auto& def_defn : defs_defn) {
+            log_file << def_defn.second->name;
+            for(auto& param : def_defn.second->params) log_file << " " << param;
+            log_file << ":\n";
+            def_defn.second->body->print(1, log_file);
+        }
     }
 
+    // The source's own data types, before the type checker adds Bool and List.
+    std::set<std::string> own_data;
+    for(auto& def_data : defs_data) own_data.insert(def_data.first);
+    imported_modules imported;
+    bool is_module = !options.module_name.empty();
+
     try {
-        typecheck_program(defs_data, defs_defn, mgr, env);
-        log_file << "\n\n\n[Typecheck result:]\n";
-        for(auto& pair : env->names) {
-            char fi_letter = pair.first[0];
-            log_file << pair.first << ": ";
-            pair.second->print(mgr, log_file);
-            log_file << "\n";
+        if (is_module) {
+            if (defs_defn.count("main"))
+                throw type_error("A module cannot define main.");
+            if (std::find(imports.begin(), imports.end(), options.module_name) != imports.end())
+                throw type_error("Module " + options.module_name + " imports itself.");
+            for(auto& def_defn : defs_defn) def_defn.second->exported = true;
         }
 
-        compile_program(defs_defn);
-        log_file << "\n\n\n[Compile result:]\n";
-        for(auto& def_defn : defs_defn) {
-            log_file << def_defn.second->name << ":\n";
-            for(auto& instruction : def_defn.second->instructions) {
-                instruction->print(0, log_file);
+        {
+            phase_timer timer(report, "typecheck");
+            typecheck_program(defs_data, defs_defn, mgr, env, options.jobs, imported);
+        }
+        if (options.dump_types) {
+            log_file << "\n\n\n[Typecheck result:]\n";
+            for(auto& pair : env->names) {
+                log_file << pair.first << ": ";
+                pair.second->print(mgr, log_file);
+                log_file << "\n";
             }
-            log_file << "\n";
+        }
+        if (is_module) {
+            write_interface(options.module_name, imports, defs_data, own_data, defs_defn, mgr, env);
+        }
+
+        {
+            phase_timer timer(report, "specialize");
+            pass_log << "\n\n\n[Specialize:]\n";
+            specialize_program(defs_defn, mgr, env, pass_log);
+        }
+
+        {
+            phase_timer timer(report, "inline");
+            pass_log << "\n\n\n[Inline:]\n";
+            inline_program(defs_defn, options, pass_log);
         }
 
-        gen_llvm(defs_data, defs_defn);
+        {
+            phase_timer timer(report, "compile");
+            compile_program(defs_defn);
+        }
+
+        {
+            phase_timer timer(report, "peephole");
+            pass_log << "\n\n\n[Peephole:]\n";
+            int total_before = 0, total_after = 0;
+            for(auto& def_defn : defs_defn) {
+                int before = options.dump_gcode ? count_instructions(def_defn.second->instructions) : 0;
+                optimize_instructions(def_defn.second->instructions);
+                if (!options.dump_gcode) continue;
+                int after = count_instructions(def_defn.second->instructions);
+                pass_log << def_defn.second->name << ": " << before << " -> " << after << "\n";
+                total_before += before;
+                total_after += after;
+            }
+            pass_log << "total: " << total_before << " -> " << total_after << "\n";
+        }
+
+        if (options.dump_gcode) {
+            log_file << "\n\n\n[Compile result:]\n";
+            for(auto& def_defn : defs_defn) {
+                log_file << def_defn.second->name << ":\n";
+                for(auto& instruction : def_defn.second->instructions) {
+                    instruction->print(0, log_file);
+                }
+                log_file << "\n";
+            }
+        }
+
+        {
+            // LLVM times its own passes, including those output_llvm runs to optimize and emit.
+            phase_timer timer(report, "llvm");
+            llvm::TimePassesIsEnabled = options.time_report;
+            if (options.cache) {
+                compile_cache cache(".func_cache");
+                cache.compute_keys(defs_data, defs_defn, mgr, env, options, imported.globals);
+                gen_llvm(defs_data, defs_defn, options, &cache, own_data, imported);
+            } else {
+                gen_llvm(defs_data, defs_defn, options, nullptr, own_data, imported);
+            }
+        }
 
         std::cout << "Compiled successfully." << std::endl;
     } catch(unification_error& err) {
@@ -543,6 +1117,11 @@ int main() {
         std::cout << "Unexpected Error: " << err.description << std::endl;
     }
 
+    if (report) {
+        report->print(std::cerr);
+        llvm::reportAndResetTimings(&llvm::errs());
+    }
+
     if (log_file.is_open()) {
         log_file.close();
     }
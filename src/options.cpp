@@ -0,0 +1,88 @@
+#include "options.hpp"
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+
+static void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options] < source" << std::endl;
+    std::cout << "  --inline-size=N      inline definitions of at most N AST nodes (0 disables)" << std::endl;
+    std::cout << "  --no-inline-single   do not inline single-use definitions regardless of size" << std::endl;
+    std::cout << "  --no-bounds-checks   do not check array indices at run time" << std::endl;
+    std::cout << "  --wide-numbers       compile Int as 64-bit and Float as double" << std::endl;
+    std::cout << "  --jobs=N             type check independent definitions on N threads" << std::endl;
+    std::cout << "  --codegen-partitions=N  generate code as N modules in parallel" << std::endl;
+    std::cout << "  --cache              reuse object code of unchanged definitions from .func_cache" << std::endl;
+    std::cout << "  --module=Name        compile a module for import into Name.o and Name.fi" << std::endl;
+    std::cout << "  --time-report        print the time and peak memory of each phase" << std::endl;
+    std::cout << "  --dump-ast, --dump-types, --dump-gcode" << std::endl;
+    std::cout << "                       write the AST, types or G-code to log.txt" << std::endl;
+    std::cout << "  --dump-ir            write the LLVM IR to llvm_log.txt" << std::endl;
+}
+
+static bool parse_int(const std::string& text, int& into) {
+    try {
+        size_t used;
+        into = std::stoi(text, &used);
+        return used == text.size() && into >= 0;
+    } catch(std::exception&) {
+        return false;
+    }
+}
+
+bool parse_options(int argc, char** argv, compiler_options& options) {
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if(arg.rfind("--inline-size=", 0) == 0) {
+            if(!parse_int(arg.substr(14), options.inline_size)) {
+                std::cout << "Invalid value in " << arg << "." << std::endl;
+                return false;
+            }
+        } else if(arg == "--no-inline-single") {
+            options.inline_single_use = false;
+        } else if(arg == "--no-bounds-checks") {
+            options.bounds_checks = false;
+        } else if(arg == "--wide-numbers") {
+            options.wide_numbers = true;
+        } else if(arg.rfind("--codegen-partitions=", 0) == 0) {
+            if(!parse_int(arg.substr(21), options.codegen_partitions) || options.codegen_partitions == 0) {
+                std::cout << "Invalid value in " << arg << "." << std::endl;
+                return false;
+            }
+        } else if(arg == "--cache") {
+            options.cache = true;
+        } else if(arg.rfind("--module=", 0) == 0) {
+            // Module names are UIDs, as in import.
+            options.module_name = arg.substr(9);
+            auto& name = options.module_name;
+            if(name.empty() || !std::isupper((unsigned char) name[0]) ||
+                    !std::all_of(name.begin(), name.end(), [](unsigned char c) { return std::isalpha(c); })) {
+                std::cout << "Invalid module name in " << arg << "." << std::endl;
+                return false;
+            }
+        } else if(arg == "--time-report") {
+            options.time_report = true;
+        } else if(arg == "--dump-ast") {
+            options.dump_ast = true;
+        } else if(arg == "--dump-types") {
+            options.dump_types = true;
+        } else if(arg == "--dump-gcode") {
+            options.dump_gcode = true;
+        } else if(arg == "--dump-ir") {
+            options.dump_ir = true;
+        } else if(arg.rfind("--jobs=", 0) == 0) {
+            if(!parse_int(arg.substr(7), options.jobs) || options.jobs == 0) {
+                std::cout << "Invalid value in " << arg << "." << std::endl;
+                return false;
+            }
+        } else {
+            std::cout << "Unknown option " << arg << "." << std::endl;
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+    if(!options.module_name.empty() && (options.cache || options.codegen_partitions > 1)) {
+        std::cout << "--module cannot be combined with --cache or --codegen-partitions." << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+
+struct compiler_options {
+    // Definitions whose body has at most this many AST nodes are inlined; 0 disables it.
+    int inline_size = 12;
+    // Definitions referenced exactly once are inlined whatever their size.
+    bool inline_single_use = true;
+    // Array accesses check their index; turned off for release builds.
+    bool bounds_checks = true;
+    // Int is i64 and Float is double; the runtime must be built with -DWIDE_NUMBERS to match.
+    bool wide_numbers = false;
+    // Threads used to type check independent recursion groups.
+    int jobs = 1;
+    // Modules the definitions are split over, generated and emitted on one thread each.
+    int codegen_partitions = 1;
+    // Reuse the object code of unchanged definitions from .func_cache.
+    bool cache = false;
+    // Compile the source as this module, into Name.o and its interface Name.fi; empty for a program.
+    std::string module_name;
+    // Print the wall time and peak memory of each phase, and LLVM's pass timings, to stderr.
+    bool time_report = false;
+    // Write the AST, the inferred types and the G-code (with the optimization logs) to log.txt,
+    // and the LLVM IR to llvm_log.txt.
+    bool dump_ast = false;
+    bool dump_types = false;
+    bool dump_gcode = false;
+    bool dump_ir = false;
+};
+
+// Returns false (after printing why) if the command line cannot be parsed.
+bool parse_options(int argc, char** argv, compiler_options& options);
@@ -9,7 +9,7 @@ type_ptr parsed_type_app::to_type(
     auto parent_type = e.lookup_type(name);
     if(parent_type == nullptr) throw unexpected_error("parsed_type_app::to_type: name not found");
     type_base* base_type;
-    if(!(base_type = dynamic_cast<type_base*>(parent_type.get()))) throw unexpected_error("parsed_type_app::to_type: parent_type is not type_base");
+    if(!(base_type = type_cast<type_base>(parent_type.get()))) throw unexpected_error("parsed_type_app::to_type: parent_type is not type_base");
     if(base_type->arity != arguments.size()) throw unexpected_error("parsed_type_app::to_type: base_type->arity != arguments.size()");
 
     type_app* new_app = new type_app(std::move(parent_type));
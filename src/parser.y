@@ -9,6 +9,7 @@
 
 std::map<std::string, definition_data_ptr> defs_data;
 std::map<std::string, definition_defn_ptr> defs_defn;
+std::vector<std::string> imports;
 
 extern yy::parser::symbol_type yylex();
 extern int yylineno;
@@ -32,12 +33,13 @@ void yyerror(const std::string &msg) {
 %left TIMES DIVIDE BMOD
 %left CONNECT
 
-%token <float> FLOATNUMBER
-%token <int> INTEGER
+%token <double> FLOATNUMBER
+%token <int64_t> INTEGER
 %token <char> CHARINSTANCE
 %token <std::string> STRINGINSTANCE
 %token DEFN
 %token DATA
+%token IMPORT
 %token CASE
 %token OF
 %token DO
@@ -91,6 +93,7 @@ definitions
 definition
     : defn { auto name = $1->name; defs_defn[name] = std::move($1); }
     | data { auto name = $1->name; defs_data[name] = std::move($1); }
+    | IMPORT UID { imports.push_back(std::move($2)); }
     ;
 
 defn
@@ -0,0 +1,99 @@
+#include "peephole.hpp"
+
+int count_instructions(const std::vector<instruction_ptr>& instructions) {
+    int count = 0;
+    for(auto& instruction : instructions) {
+        count++;
+        if(auto jump = dynamic_cast<const instruction_jump*>(instruction.get())) {
+            for(auto& branch : jump->branches) count += count_instructions(branch);
+        }
+    }
+    return count;
+}
+
+// Instructions that leave a node in WHNF on top of the stack, so a following Eval does nothing.
+static bool leaves_whnf(const instruction* i) {
+    if(auto binop = dynamic_cast<const instruction_binop*>(i)) return binop->op != CONN;
+    return dynamic_cast<const instruction_pack*>(i) ||
+        dynamic_cast<const instruction_pushint*>(i) ||
+        dynamic_cast<const instruction_pushfloat*>(i) ||
+        dynamic_cast<const instruction_pushchar*>(i) ||
+        dynamic_cast<const instruction_pushliteral*>(i) ||
+        dynamic_cast<const instruction_uniop*>(i) ||
+        dynamic_cast<const instruction_eval*>(i);
+}
+
+// Instructions that only push an existing or fresh node, so Pop can cancel them.
+static bool is_plain_push(const instruction* i) {
+    return dynamic_cast<const instruction_push*>(i) ||
+        dynamic_cast<const instruction_pushglobal*>(i) ||
+        dynamic_cast<const instruction_pushint*>(i) ||
+        dynamic_cast<const instruction_pushfloat*>(i) ||
+        dynamic_cast<const instruction_pushchar*>(i) ||
+        dynamic_cast<const instruction_pushliteral*>(i);
+}
+
+static bool leaves_function(const instruction* i) {
+    return dynamic_cast<const instruction_selfcall*>(i) ||
+        dynamic_cast<const instruction_tailcall*>(i);
+}
+
+static void emit_pop(std::vector<instruction_ptr>& into, int count) {
+    while(count > 0 && !into.empty()) {
+        instruction* last = into.back().get();
+        if(auto pop = dynamic_cast<instruction_pop*>(last)) {
+            count += pop->count;
+        } else if(auto slide = dynamic_cast<instruction_slide*>(last)) {
+            // Slide(n); Pop(m) drops the same n + m nodes as Pop(n + m).
+            count += slide->offset;
+        } else if(is_plain_push(last)) {
+            count--;
+        } else {
+            break;
+        }
+        into.pop_back();
+    }
+    if(count > 0) into.push_back(instruction_ptr(new instruction_pop(count)));
+}
+
+void optimize_instructions(std::vector<instruction_ptr>& instructions) {
+    std::vector<instruction_ptr> result;
+
+    for(auto& next : instructions) {
+        // Anything after a tail call is unreachable.
+        if(!result.empty() && leaves_function(result.back().get())) break;
+
+        instruction* last = result.empty() ? nullptr : result.back().get();
+        if(auto jump = dynamic_cast<instruction_jump*>(next.get())) {
+            for(auto& branch : jump->branches) optimize_instructions(branch);
+        } else if(auto pop = dynamic_cast<instruction_pop*>(next.get())) {
+            emit_pop(result, pop->count);
+            continue;
+        } else if(auto split = dynamic_cast<instruction_split*>(next.get())) {
+            if(split->size == 0) {
+                emit_pop(result, 1);
+                continue;
+            }
+        } else if(auto slide = dynamic_cast<instruction_slide*>(next.get())) {
+            if(slide->offset == 0) continue;
+            if(auto last_slide = dynamic_cast<instruction_slide*>(last)) {
+                last_slide->offset += slide->offset;
+                continue;
+            }
+        } else if(dynamic_cast<instruction_eval*>(next.get())) {
+            if(last && leaves_whnf(last)) continue;
+        } else if(dynamic_cast<instruction_mkapp*>(next.get())) {
+            // PushGlobal(f); MkApp; ...; MkApp builds a call spine in one go.
+            if(auto global = dynamic_cast<instruction_pushglobal*>(last)) {
+                result.back() = instruction_ptr(new instruction_pushapp(global->name, 1));
+                continue;
+            } else if(auto app = dynamic_cast<instruction_pushapp*>(last)) {
+                app->count++;
+                continue;
+            }
+        }
+        result.push_back(std::move(next));
+    }
+
+    instructions = std::move(result);
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include <vector>
+#include "instruction.hpp"
+
+int count_instructions(const std::vector<instruction_ptr>& instructions);
+void optimize_instructions(std::vector<instruction_ptr>& instructions);
@@ -7,9 +7,8 @@ void generate_read_llvm(llvm_context &ctx) {
     Function *f = ctx.create_custom_function("read", 0);
     ctx.builder.SetInsertPoint(&f->getEntryBlock());
 
-    FunctionType *getchar_type = FunctionType::get(ctx.builder.getInt32Ty(), false);
-    FunctionCallee getchar_func = ctx.module.getOrInsertFunction("getchar", getchar_type);
-    Value *getchar_call = ctx.builder.CreateCall(getchar_func, {});
+    // input_char reads through the runtime's stdin buffer, shared with readInt and friends.
+    Value *getchar_call = ctx.builder.CreateCall(ctx.functions.at("input_char"), {});
 
     FunctionType* isspace_type = FunctionType::get(
         ctx.builder.getInt32Ty(), 
@@ -29,14 +28,14 @@ void generate_read_llvm(llvm_context &ctx) {
     ctx.builder.CreateCondBr(sign, true_block, false_block);
     
     ctx.builder.SetInsertPoint(true_block);
-    ctx.create_push(f, ctx.create_global(f, ctx.custom_functions.at("f__Nil")->function, ctx.create_i32(0)));
+    ctx.create_push(f, ctx.create_global_ref(f, *ctx.get_custom_function("f__Nil")));
     ctx.builder.CreateBr(safety_block);
 
     ctx.builder.SetInsertPoint(false_block);
     ctx.create_push(f, ctx.create_global(f, f, ctx.create_i32(0)));
     ctx.create_unwind(f);
     ctx.create_pack(f, ctx.create_size(0), ret_char);
-    Value *n_cons = ctx.create_global(f, ctx.custom_functions.at("f__Cons")->function, ctx.create_i32(2));
+    Value *n_cons = ctx.create_global_ref(f, *ctx.get_custom_function("f__Cons"));
     Value *n_char = ctx.create_pop(f);
     Value *n_app = ctx.create_app(f, n_cons, n_char);
     Value *n_branch = ctx.create_pop(f);
@@ -51,63 +50,109 @@ void generate_read_llvm(llvm_context &ctx) {
     ctx.builder.CreateRetVoid();
 }
 
-void generate_print_llvm(llvm_context &ctx) {
-    Function *f = ctx.create_custom_function("print", 1);
-    ctx.builder.SetInsertPoint(&f->getEntryBlock());
-
-    FunctionType *putchar_type = FunctionType::get(ctx.builder.getInt32Ty(), { ctx.builder.getInt32Ty() }, false);
-    FunctionCallee putchar_func = ctx.module.getOrInsertFunction("putchar", putchar_type);
+void generate_readTyped_llvm(llvm_context &ctx) {
+    // Each of these parses straight from the input buffer; the runtime allocates the result.
+    std::vector<std::pair<std::string, std::string>> readers = {
+        { "readInt", "read_int" },
+        { "readFloat", "read_float" },
+        { "readLine", "gmachine_read_line" },
+        { "readWord", "gmachine_read_word" },
+    };
+    for(auto& reader : readers) {
+        Function *f = ctx.create_custom_function(reader.first, 0);
+        ctx.builder.SetInsertPoint(&f->getEntryBlock());
+
+        Function *runtime_f = ctx.functions.at(reader.second);
+        if(runtime_f->arg_size() == 0) {
+            Value *node = ctx.builder.CreateCall(runtime_f, {});
+            ctx.create_push(f, ctx.create_track(f, node));
+        } else {
+            ctx.create_push(f, ctx.builder.CreateCall(runtime_f, { f->arg_begin() }));
+        }
+
+        ctx.create_update(f, ctx.create_size(0));
+
+        ctx.builder.CreateRetVoid();
+    }
+}
 
-    ctx.create_unwind(f);
+void generate_getContents_llvm(llvm_context& ctx) {
+    // _contents produces one cell of the input list; its tail is a fresh _contents node,
+    // so the next character is only read once the consumer forces that tail.
+    Function *next_f = ctx.create_custom_function("_contents", 0);
+    ctx.builder.SetInsertPoint(&next_f->getEntryBlock());
 
-    Value *top_node = ctx.create_peek(f, ctx.create_size(0));
-    Value *tag_i8 = ctx.unwrap_data_tag(top_node);
-    Value *tag_i1 = ctx.builder.CreateICmpNE(tag_i8, ConstantInt::get(ctx.builder.getInt8Ty(), 0));
+    Value *c = ctx.builder.CreateCall(ctx.functions.at("input_char"), {});
+    Value *is_eof = ctx.builder.CreateICmpSLT(c, ctx.create_i32(0));
 
-    BasicBlock *safety_block = BasicBlock::Create(ctx.ctx, "safety", f);
-    BasicBlock *cons_block = BasicBlock::Create(ctx.ctx, "consBlock", f);
-    BasicBlock *nil_block = BasicBlock::Create(ctx.ctx, "nilBlock", f);
+    BasicBlock *eof_block = BasicBlock::Create(ctx.ctx, "eof", next_f);
+    BasicBlock *cons_block = BasicBlock::Create(ctx.ctx, "cons", next_f);
+    BasicBlock *safety_block = BasicBlock::Create(ctx.ctx, "safety", next_f);
+    ctx.builder.CreateCondBr(is_eof, eof_block, cons_block);
 
-    ctx.builder.CreateCondBr(tag_i1, cons_block, nil_block);
+    ctx.builder.SetInsertPoint(eof_block);
+    ctx.create_pack(next_f, ctx.create_size(0), ctx.create_i8(0));
+    ctx.builder.CreateBr(safety_block);
 
     ctx.builder.SetInsertPoint(cons_block);
-    ctx.create_split(f, ctx.create_size(2));
-    ctx.create_unwind(f);
+    ctx.create_push(next_f, ctx.create_global(next_f, next_f, ctx.create_i32(0)));
+    ctx.create_pack(next_f, ctx.create_size(0), ctx.builder.CreateTrunc(c, ctx.builder.getInt8Ty()));
+    ctx.create_pack(next_f, ctx.create_size(2), ctx.create_i8(1));
+    ctx.builder.CreateBr(safety_block);
 
-    Value *top_char_node = ctx.create_pop(f);
-    Value *char_val_i8 = ctx.unwrap_data_tag(top_char_node);
-    Value *char_val_i32 = ctx.builder.CreateZExt(char_val_i8, ctx.builder.getInt32Ty());
-    ctx.builder.CreateCall(putchar_func, { char_val_i32 });
+    ctx.builder.SetInsertPoint(safety_block);
+    ctx.create_update(next_f, ctx.create_size(0));
+    ctx.builder.CreateRetVoid();
 
-    Value *recur_print = ctx.create_global(f, f, ctx.create_i32(1));
-    Value *n_xs = ctx.create_pop(f);
-    ctx.create_push(f, ctx.create_app(f, recur_print, n_xs));
-    ctx.create_unwind(f);
+    Function *f = ctx.create_custom_function("getContents", 0);
+    ctx.builder.SetInsertPoint(&f->getEntryBlock());
 
-    ctx.builder.CreateBr(safety_block);
+    ctx.create_push(f, ctx.create_global(f, next_f, ctx.create_i32(0)));
+    ctx.create_update(f, ctx.create_size(0));
 
-    ctx.builder.SetInsertPoint(nil_block);
+    ctx.builder.CreateRetVoid();
+}
 
-    // Value *newline_val = ctx.builder.getInt32('\n');
-    // ctx.builder.CreateCall(putchar_func, { newline_val });
-    
-    ctx.builder.CreateBr(safety_block);
+void generate_print_llvm(llvm_context &ctx) {
+    Function *f = ctx.create_custom_function("print", 1);
+    ctx.builder.SetInsertPoint(&f->getEntryBlock());
 
-    ctx.builder.SetInsertPoint(safety_block);
+    // gmachine_print forces the list iteratively into the output buffer, leaving the final _Nil on top.
+    ctx.builder.CreateCall(ctx.functions.at("gmachine_print"), { f->arg_begin() });
 
     ctx.create_update(f, ctx.create_size(0));
 
     ctx.builder.CreateRetVoid();
 }
 
+void generate_printNum_llvm(llvm_context &ctx) {
+    for(bool is_float : { false, true }) {
+        Function *f = ctx.create_custom_function(is_float ? "printFloat" : "printInt", 1);
+        ctx.builder.SetInsertPoint(&f->getEntryBlock());
+
+        ctx.create_unwind(f);
+        Value *top_node = ctx.create_peek(f, ctx.create_size(0));
+        // A Float may still be a NODE_NUM, as from charToNum or unspecialized Num code.
+        Value *value = is_float ? ctx.unwrap_num_as_float(top_node) : ctx.unwrap_num(top_node);
+        ctx.builder.CreateCall(ctx.functions.at(is_float ? "output_float" : "output_int"), { value });
+
+        // Like print, the result is an empty data node rather than the number.
+        ctx.create_pop(f);
+        ctx.create_push(f, ctx.create_literal_data(0, {}));
+        ctx.create_update(f, ctx.create_size(0));
+
+        ctx.builder.CreateRetVoid();
+    }
+}
+
 void generate_charToNum_llvm(llvm_context& ctx) {
     auto f = ctx.create_custom_function("charToNum", 1);
     ctx.builder.SetInsertPoint(&f->getEntryBlock());
 
     (new instruction_push(0))->gen_llvm(ctx, f);
     (new instruction_eval())->gen_llvm(ctx, f);
-    ctx.create_push(f, ctx.create_num(f, ctx.builder.CreateZExt(  // i8 -> i32
-            ctx.unwrap_data_tag(ctx.create_pop(f)), llvm::Type::getInt32Ty(ctx.ctx))));
+    ctx.create_push(f, ctx.create_num(f, ctx.builder.CreateZExt(  // i8 -> Int
+            ctx.unwrap_data_tag(ctx.create_pop(f)), ctx.int_value_type)));
     (new instruction_update(1))->gen_llvm(ctx, f);
     (new instruction_pop(1))->gen_llvm(ctx, f);
 
@@ -120,7 +165,7 @@ void generate_numToChar_llvm(llvm_context& ctx) {
 
     (new instruction_push(0))->gen_llvm(ctx, f);
     (new instruction_eval())->gen_llvm(ctx, f);
-    ctx.create_pack(f, ctx.create_size(0), ctx.builder.CreateTrunc(  // i32 -> i8
+    ctx.create_pack(f, ctx.create_size(0), ctx.builder.CreateTrunc(  // Int -> i8
             ctx.unwrap_num(ctx.create_pop(f)), llvm::Type::getInt8Ty(ctx.ctx)));
     (new instruction_update(1))->gen_llvm(ctx, f);
     (new instruction_pop(1))->gen_llvm(ctx, f);
@@ -135,7 +180,7 @@ void generate_floatToNum_llvm(llvm_context& ctx) {
     (new instruction_push(0))->gen_llvm(ctx, f);
     (new instruction_eval())->gen_llvm(ctx, f);
     ctx.create_push(f, ctx.create_num(f, ctx.builder.CreateFPToSI(
-            ctx.unwrap_float(ctx.create_pop(f)), llvm::Type::getInt32Ty(ctx.ctx))));
+            ctx.unwrap_float(ctx.create_pop(f)), ctx.int_value_type)));
     (new instruction_update(1))->gen_llvm(ctx, f);
     (new instruction_pop(1))->gen_llvm(ctx, f);
 
@@ -149,7 +194,7 @@ void generate_intToFloat_llvm(llvm_context& ctx) {
     (new instruction_push(0))->gen_llvm(ctx, f);
     (new instruction_eval())->gen_llvm(ctx, f);
     ctx.create_push(f, ctx.create_float(f, ctx.builder.CreateSIToFP(
-            ctx.unwrap_num(ctx.create_pop(f)), llvm::Type::getFloatTy(ctx.ctx))));
+            ctx.unwrap_num(ctx.create_pop(f)), ctx.float_value_type)));
     (new instruction_update(1))->gen_llvm(ctx, f);
     (new instruction_pop(1))->gen_llvm(ctx, f);
 
@@ -160,43 +205,8 @@ void generate_array_llvm(llvm_context &ctx) {
     Function *f = ctx.create_custom_function("array", 1);
     ctx.builder.SetInsertPoint(&f->getEntryBlock());
 
-    BasicBlock *loop_block = BasicBlock::Create(ctx.ctx, "loop", f);
-    BasicBlock *cons_block = BasicBlock::Create(ctx.ctx, "cons", f);
-    BasicBlock *final_block = BasicBlock::Create(ctx.ctx, "final", f);
-
-    llvm::AllocaInst *counter = ctx.builder.CreateAlloca(ctx.builder.getInt32Ty(), nullptr);
-    ctx.builder.CreateStore(ctx.builder.getInt32(0), counter);
-
-    ctx.builder.CreateBr(loop_block);
-
-    ctx.builder.SetInsertPoint(loop_block);
-    ctx.create_unwind(f);
-    Value *top_node = ctx.create_peek(f, ctx.create_size(0));
-    Value *tag_i8 = ctx.unwrap_data_tag(top_node);
-    Value *tag_i1 = ctx.builder.CreateICmpNE(tag_i8, ConstantInt::get(ctx.builder.getInt8Ty(), 0));
-    ctx.builder.CreateCondBr(tag_i1, cons_block, final_block);
-
-    ctx.builder.SetInsertPoint(cons_block);
-
-    ctx.create_split(f, ctx.create_size(2));
-    Value *node_1 = ctx.create_pop(f);
-    Value *node_2 = ctx.create_pop(f);
-    ctx.create_disablegc(f);
-    ctx.create_push(f, node_1);
-    ctx.create_enablegc(f);
-    ctx.create_push(f, node_2);
-
-    Value *cur_val = ctx.builder.CreateLoad(counter);
-    Value *add_one = ctx.builder.CreateAdd(cur_val, ctx.builder.getInt32(1));
-    ctx.builder.CreateStore(add_one, counter);
-
-    ctx.builder.CreateBr(loop_block);
-
-    ctx.builder.SetInsertPoint(final_block);
-    ctx.create_popn(f, ctx.create_size(1));
-    Value *final_val = ctx.builder.CreateLoad(counter);
-    Value *final_val_i8 = ctx.builder.CreateTrunc(final_val, ctx.builder.getInt8Ty());
-    ctx.create_pack(f, final_val, final_val_i8);
+    // gmachine_array evaluates the list on top of the stack and replaces it with the array.
+    ctx.create_array(f);
 
     ctx.create_update(f, ctx.create_size(0));
 
@@ -209,8 +219,7 @@ void generate_size_llvm(llvm_context &ctx) {
 
     ctx.create_unwind(f);
     Value *top_node = ctx.create_pop(f);
-    Value *tag = ctx.unwrap_data_tag(top_node);
-    Value *size = ctx.builder.CreateZExt(tag, ctx.builder.getInt32Ty());
+    Value *size = ctx.unwrap_array_length(top_node);
     ctx.create_push(f, ctx.create_num(f, size));
 
     ctx.create_update(f, ctx.create_size(0));
@@ -226,7 +235,7 @@ void generate_access_llvm(llvm_context &ctx) {
     Value *array = ctx.create_pop(f);
     ctx.create_unwind(f);
     Value *index = ctx.create_pop(f);
-    ctx.create_push(f, ctx.access_array(array, index));
+    ctx.create_push(f, ctx.access_array(f, array, index));
 
     ctx.create_update(f, ctx.create_size(0));
 
@@ -242,10 +251,227 @@ void generate_modify_llvm(llvm_context &ctx) {
     ctx.create_unwind(f);
     Value *index = ctx.create_pop(f);
     Value *operand = ctx.create_pop(f);
-    ctx.modify_array(array, index, operand);
+    ctx.modify_array(f, array, index, operand);
     ctx.create_push(f, array);
 
     ctx.create_update(f, ctx.create_size(0));
 
     ctx.builder.CreateRetVoid();
 }
+
+// Must match enum array_op in runtime.h.
+enum array_op { ARRAY_ADD, ARRAY_SUB, ARRAY_MUL, ARRAY_MIN, ARRAY_MAX };
+
+// Pushes the result of a runtime kernel, given arguments evaluated and popped in order.
+static void generate_kernel_llvm(llvm_context &ctx, const std::string& name, int32_t arity,
+        const std::string& kernel, std::vector<Value*> leading) {
+    Function *f = ctx.create_custom_function(name, arity);
+    ctx.builder.SetInsertPoint(&f->getEntryBlock());
+
+    std::vector<Value*> args = std::move(leading);
+    for(int32_t i = 0; i < arity; i++) {
+        ctx.create_unwind(f);
+        args.push_back(ctx.create_pop(f));
+    }
+    Value *result = ctx.builder.CreateCall(ctx.functions.at(kernel), args);
+    ctx.create_push(f, ctx.create_track(f, result));
+
+    ctx.create_update(f, ctx.create_size(0));
+
+    ctx.builder.CreateRetVoid();
+}
+
+void generate_unboxed_array_llvm(llvm_context &ctx, bool is_float) {
+    std::string prefix = is_float ? "float" : "int";
+    StructType *array_type = ctx.struct_types.at(is_float ? "node_float_array" : "node_int_array");
+    auto box = [&](Function *f, Value *v) {
+        return is_float ? ctx.create_float(f, v) : ctx.create_num(f, v);
+    };
+
+    {
+        Function *f = ctx.create_custom_function(prefix + "Array", 1);
+        ctx.builder.SetInsertPoint(&f->getEntryBlock());
+        ctx.create_unboxed_array(f, is_float);
+        ctx.create_update(f, ctx.create_size(0));
+        ctx.builder.CreateRetVoid();
+    }
+
+    {
+        Function *f = ctx.create_custom_function(prefix + "Size", 1);
+        ctx.builder.SetInsertPoint(&f->getEntryBlock());
+        ctx.create_unwind(f);
+        Value *array = ctx.create_pop(f);
+        ctx.create_push(f, ctx.create_num(f, ctx.unwrap_array_length(array)));
+        ctx.create_update(f, ctx.create_size(0));
+        ctx.builder.CreateRetVoid();
+    }
+
+    {
+        Function *f = ctx.create_custom_function(prefix + "Access", 2);
+        ctx.builder.SetInsertPoint(&f->getEntryBlock());
+        ctx.create_unwind(f);
+        Value *array = ctx.create_pop(f);
+        ctx.create_unwind(f);
+        Value *index = ctx.create_pop(f);
+        Value *element_ptr = ctx.create_array_element_ptr(f, array_type, array, index);
+        Value *element = ctx.builder.CreateLoad(element_ptr);
+        ctx.create_push(f, box(f, element));
+        ctx.create_update(f, ctx.create_size(0));
+        ctx.builder.CreateRetVoid();
+    }
+
+    {
+        // Unlike modify, the new element has to be evaluated before it is stored.
+        Function *f = ctx.create_custom_function(prefix + "Modify", 3);
+        ctx.builder.SetInsertPoint(&f->getEntryBlock());
+        ctx.create_unwind(f);
+        Value *array = ctx.create_pop(f);
+        ctx.create_unwind(f);
+        Value *index = ctx.create_pop(f);
+        ctx.create_unwind(f);
+        Value *operand = ctx.create_pop(f);
+        Value *element_ptr = ctx.create_array_element_ptr(f, array_type, array, index);
+        // A Float may still be a NODE_NUM, as from charToNum or unspecialized Num code.
+        ctx.builder.CreateStore(is_float ? ctx.unwrap_num_as_float(operand) : ctx.unwrap_num(operand), element_ptr);
+        ctx.create_push(f, array);
+        ctx.create_update(f, ctx.create_size(0));
+        ctx.builder.CreateRetVoid();
+    }
+
+    generate_kernel_llvm(ctx, prefix + "Add", 2, "unboxed_array_zip", { ctx.create_i8(ARRAY_ADD) });
+    generate_kernel_llvm(ctx, prefix + "Sub", 2, "unboxed_array_zip", { ctx.create_i8(ARRAY_SUB) });
+    generate_kernel_llvm(ctx, prefix + "Mul", 2, "unboxed_array_zip", { ctx.create_i8(ARRAY_MUL) });
+    generate_kernel_llvm(ctx, prefix + "Offset", 2, "unboxed_array_map", { ctx.create_i8(ARRAY_ADD) });
+    generate_kernel_llvm(ctx, prefix + "Scale", 2, "unboxed_array_map", { ctx.create_i8(ARRAY_MUL) });
+    generate_kernel_llvm(ctx, prefix + "Sum", 1, "unboxed_array_fold", { ctx.create_i8(ARRAY_ADD) });
+    generate_kernel_llvm(ctx, prefix + "Minimum", 1, "unboxed_array_fold", { ctx.create_i8(ARRAY_MIN) });
+    generate_kernel_llvm(ctx, prefix + "Maximum", 1, "unboxed_array_fold", { ctx.create_i8(ARRAY_MAX) });
+    generate_kernel_llvm(ctx, prefix + "Dot", 2, "unboxed_array_dot", {});
+
+    {
+        Function *f = ctx.create_custom_function(prefix + "Sort", 1);
+        ctx.builder.SetInsertPoint(&f->getEntryBlock());
+        ctx.create_unwind(f);
+        Value *array = ctx.create_pop(f);
+        ctx.builder.CreateCall(ctx.functions.at("unboxed_array_sort"), { array });
+        ctx.create_push(f, array);
+        ctx.create_update(f, ctx.create_size(0));
+        ctx.builder.CreateRetVoid();
+    }
+
+    for(std::string name : { "Search", "Partition" }) {
+        Function *f = ctx.create_custom_function(prefix + name, 2);
+        ctx.builder.SetInsertPoint(&f->getEntryBlock());
+        ctx.create_unwind(f);
+        Value *array = ctx.create_pop(f);
+        ctx.create_unwind(f);
+        Value *operand = ctx.create_pop(f);
+        std::string kernel = name == "Search" ? "unboxed_array_search" : "unboxed_array_partition";
+        Value *index = ctx.builder.CreateCall(ctx.functions.at(kernel), { array, operand });
+        ctx.create_push(f, ctx.create_num(f, index));
+        ctx.create_update(f, ctx.create_size(0));
+        ctx.builder.CreateRetVoid();
+    }
+}
+
+void generate_sort_llvm(llvm_context &ctx) {
+    // sort and sortByKey share gmachine_sort; a null key function sorts by the elements themselves.
+    for(bool by_key : { false, true }) {
+        Function *f = ctx.create_custom_function(by_key ? "sortByKey" : "sort", by_key ? 2 : 1);
+        ctx.builder.SetInsertPoint(&f->getEntryBlock());
+        Value *key_f = ConstantPointerNull::get(ctx.node_ptr_type);
+        if(by_key) key_f = ctx.create_pop(f);
+        ctx.create_unwind(f);
+        Value *array = ctx.create_pop(f);
+        ctx.builder.CreateCall(ctx.functions.at("gmachine_sort"), { f->arg_begin(), key_f, array });
+        ctx.create_push(f, array);
+        ctx.create_update(f, ctx.create_size(0));
+        ctx.builder.CreateRetVoid();
+    }
+
+    for(std::string name : { "search", "partition" }) {
+        Function *f = ctx.create_custom_function(name, 2);
+        ctx.builder.SetInsertPoint(&f->getEntryBlock());
+        ctx.create_unwind(f);
+        Value *array = ctx.create_pop(f);
+        ctx.create_unwind(f);
+        Value *operand = ctx.create_pop(f);
+        Value *index = ctx.builder.CreateCall(ctx.functions.at("gmachine_" + name), { f->arg_begin(), array, operand });
+        ctx.create_push(f, ctx.create_num(f, index));
+        ctx.create_update(f, ctx.create_size(0));
+        ctx.builder.CreateRetVoid();
+    }
+}
+
+void generate_vector_llvm(llvm_context &ctx) {
+    auto gmachine_call = [&](Function *f, const std::string& name, std::vector<Value*> args) {
+        args.insert(args.begin(), f->arg_begin());
+        return ctx.builder.CreateCall(ctx.functions.at(name), args);
+    };
+
+    {
+        Function *f = ctx.create_custom_function("vector", 1);
+        ctx.builder.SetInsertPoint(&f->getEntryBlock());
+        gmachine_call(f, "gmachine_vector", {});
+        ctx.create_update(f, ctx.create_size(0));
+        ctx.builder.CreateRetVoid();
+    }
+
+    {
+        // node_vector keeps its length where node_array does.
+        Function *f = ctx.create_custom_function("vectorSize", 1);
+        ctx.builder.SetInsertPoint(&f->getEntryBlock());
+        ctx.create_unwind(f);
+        Value *vector = ctx.create_pop(f);
+        ctx.create_push(f, ctx.create_num(f, ctx.unwrap_array_length(vector)));
+        ctx.create_update(f, ctx.create_size(0));
+        ctx.builder.CreateRetVoid();
+    }
+
+    {
+        Function *f = ctx.create_custom_function("vectorGet", 2);
+        ctx.builder.SetInsertPoint(&f->getEntryBlock());
+        ctx.create_unwind(f);
+        Value *vector = ctx.create_pop(f);
+        ctx.create_unwind(f);
+        Value *index = ctx.create_pop(f);
+        ctx.create_push(f, ctx.builder.CreateCall(ctx.functions.at("vector_get"), { vector, ctx.unwrap_num(index) }));
+        ctx.create_update(f, ctx.create_size(0));
+        ctx.builder.CreateRetVoid();
+    }
+
+    {
+        Function *f = ctx.create_custom_function("vectorSet", 3);
+        ctx.builder.SetInsertPoint(&f->getEntryBlock());
+        ctx.create_unwind(f);
+        Value *vector = ctx.create_pop(f);
+        ctx.create_unwind(f);
+        Value *index = ctx.create_pop(f);
+        Value *operand = ctx.create_pop(f);
+        ctx.create_push(f, gmachine_call(f, "gmachine_vector_set", { vector, ctx.unwrap_num(index), operand }));
+        ctx.create_update(f, ctx.create_size(0));
+        ctx.builder.CreateRetVoid();
+    }
+
+    {
+        Function *f = ctx.create_custom_function("vectorPush", 2);
+        ctx.builder.SetInsertPoint(&f->getEntryBlock());
+        ctx.create_unwind(f);
+        Value *vector = ctx.create_pop(f);
+        Value *operand = ctx.create_pop(f);
+        ctx.create_push(f, gmachine_call(f, "gmachine_vector_push", { vector, operand }));
+        ctx.create_update(f, ctx.create_size(0));
+        ctx.builder.CreateRetVoid();
+    }
+
+    {
+        Function *f = ctx.create_custom_function("vectorReplicate", 2);
+        ctx.builder.SetInsertPoint(&f->getEntryBlock());
+        ctx.create_unwind(f);
+        Value *length = ctx.create_pop(f);
+        Value *operand = ctx.create_pop(f);
+        ctx.create_push(f, gmachine_call(f, "gmachine_vector_replicate", { ctx.unwrap_num(length), operand }));
+        ctx.create_update(f, ctx.create_size(0));
+        ctx.builder.CreateRetVoid();
+    }
+}
@@ -2,7 +2,10 @@
 #include "llvm_context.hpp"
 
 void generate_read_llvm(llvm_context& ctx);
+void generate_readTyped_llvm(llvm_context& ctx);
+void generate_getContents_llvm(llvm_context& ctx);
 void generate_print_llvm(llvm_context &ctx);
+void generate_printNum_llvm(llvm_context& ctx);
 
 void generate_charToNum_llvm(llvm_context& ctx);
 void generate_numToChar_llvm(llvm_context& ctx);
@@ -12,4 +15,7 @@ void generate_intToFloat_llvm(llvm_context& ctx);
 void generate_array_llvm(llvm_context& ctx);
 void generate_size_llvm(llvm_context& ctx);
 void generate_access_llvm(llvm_context& ctx);
-void generate_modify_llvm(llvm_context& ctx);
\ No newline at end of file
+void generate_modify_llvm(llvm_context& ctx);
+void generate_unboxed_array_llvm(llvm_context& ctx, bool is_float);
+void generate_sort_llvm(llvm_context& ctx);
+void generate_vector_llvm(llvm_context& ctx);
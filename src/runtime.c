@@ -4,6 +4,16 @@
 #include <stdio.h>
 #include "runtime.h"
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Checked when linking, see llvm_context::create_number_width_check. */
+#ifdef WIDE_NUMBERS
+const int8_t runtime_wide_numbers = 1;
+#else
+const int8_t runtime_narrow_numbers = 1;
+#endif
 
 struct node_base* alloc_node() {
     struct node_base* new_node = malloc(sizeof(struct node_app));
@@ -21,14 +31,14 @@ struct node_app* alloc_app(struct node_base* l, struct node_base* r) {
     return node;
 }
 
-struct node_num* alloc_num(int32_t n) {
+struct node_num* alloc_num(num_value_t n) {
     struct node_num* node = (struct node_num*) alloc_node();
     node->base.tag = NODE_NUM;
     node->value = n;
     return node;
 }
 
-struct node_float* alloc_float(float n) {
+struct node_float* alloc_float(float_value_t n) {
     struct node_float* node = (struct node_float*) alloc_node();
     node->base.tag = NODE_FLOAT;
     node->value = n;
@@ -50,6 +60,275 @@ struct node_ind* alloc_ind(struct node_base* n) {
     return node;
 }
 
+struct node_array* alloc_array(int32_t length) {
+    /* The elements are stored inline, so this can't go through alloc_node. */
+    struct node_array* node =
+        malloc(sizeof(struct node_array) + sizeof(*node->elements) * length);
+    assert(node != NULL);
+    node->base.tag = NODE_ARRAY;
+    node->base.gc_next = NULL;
+    node->base.gc_reachable = 0;
+    node->length = length;
+    return node;
+}
+
+void array_bounds_error(num_value_t index, int32_t length) {
+    fprintf(stderr, "Array index %lld out of bounds (length %d)\n", (long long) index, length);
+    exit(1);
+}
+
+struct node_base* alloc_unboxed_array(enum node_tag tag, int32_t length) {
+    /* Int and float elements have the same size, so one layout serves both. */
+    struct node_int_array* node =
+        malloc(sizeof(struct node_int_array) + sizeof(*node->elements) * length);
+    assert(node != NULL);
+    node->base.tag = tag;
+    node->base.gc_next = NULL;
+    node->base.gc_reachable = 0;
+    node->length = length;
+    return (struct node_base*) node;
+}
+
+/*
+    Kernels for unboxed arrays. They return fresh, untracked nodes, and
+    each loop works on plain Int/Float buffers with the operation
+    switched outside of it, so the C compiler can vectorize every case.
+*/
+
+/*
+    A Float-typed value is not always a NODE_FLOAT: charToNum, floatToNum and
+    generic Num code that was not specialized produce NODE_NUM for it.
+*/
+static float_value_t node_float_value(struct node_base* n) {
+    if(n->tag == NODE_FLOAT) return ((struct node_float*) n)->value;
+    return (float_value_t) ((struct node_num*) n)->value;
+}
+
+static int32_t min_length(struct node_base* a, struct node_base* b) {
+    int32_t la = ((struct node_int_array*) a)->length;
+    int32_t lb = ((struct node_int_array*) b)->length;
+    return la < lb ? la : lb;
+}
+
+static void int_zip(int8_t op, int32_t n, num_value_t* restrict out,
+        const num_value_t* restrict a, const num_value_t* restrict b) {
+    switch(op) {
+        case ARRAY_ADD: for(int32_t i = 0; i < n; i++) out[i] = a[i] + b[i]; break;
+        case ARRAY_SUB: for(int32_t i = 0; i < n; i++) out[i] = a[i] - b[i]; break;
+        case ARRAY_MUL: for(int32_t i = 0; i < n; i++) out[i] = a[i] * b[i]; break;
+        default: assert(0);
+    }
+}
+
+static void float_zip(int8_t op, int32_t n, float_value_t* restrict out,
+        const float_value_t* restrict a, const float_value_t* restrict b) {
+    switch(op) {
+        case ARRAY_ADD: for(int32_t i = 0; i < n; i++) out[i] = a[i] + b[i]; break;
+        case ARRAY_SUB: for(int32_t i = 0; i < n; i++) out[i] = a[i] - b[i]; break;
+        case ARRAY_MUL: for(int32_t i = 0; i < n; i++) out[i] = a[i] * b[i]; break;
+        default: assert(0);
+    }
+}
+
+struct node_base* unboxed_array_zip(int8_t op, struct node_base* a, struct node_base* b) {
+    int32_t n = min_length(a, b);
+    struct node_base* result = alloc_unboxed_array(a->tag, n);
+    if(a->tag == NODE_INT_ARRAY) {
+        int_zip(op, n, ((struct node_int_array*) result)->elements,
+                ((struct node_int_array*) a)->elements, ((struct node_int_array*) b)->elements);
+    } else {
+        float_zip(op, n, ((struct node_float_array*) result)->elements,
+                ((struct node_float_array*) a)->elements, ((struct node_float_array*) b)->elements);
+    }
+    return result;
+}
+
+struct node_base* unboxed_array_map(int8_t op, struct node_base* a, struct node_base* k) {
+    int32_t n = ((struct node_int_array*) a)->length;
+    struct node_base* result = alloc_unboxed_array(a->tag, n);
+    if(a->tag == NODE_INT_ARRAY) {
+        num_value_t* restrict out = ((struct node_int_array*) result)->elements;
+        const num_value_t* restrict in = ((struct node_int_array*) a)->elements;
+        num_value_t x = ((struct node_num*) k)->value;
+        if(op == ARRAY_ADD) for(int32_t i = 0; i < n; i++) out[i] = in[i] + x;
+        else for(int32_t i = 0; i < n; i++) out[i] = in[i] * x;
+    } else {
+        float_value_t* restrict out = ((struct node_float_array*) result)->elements;
+        const float_value_t* restrict in = ((struct node_float_array*) a)->elements;
+        float_value_t x = node_float_value(k);
+        if(op == ARRAY_ADD) for(int32_t i = 0; i < n; i++) out[i] = in[i] + x;
+        else for(int32_t i = 0; i < n; i++) out[i] = in[i] * x;
+    }
+    return result;
+}
+
+static num_value_t int_fold(int8_t op, int32_t n, const num_value_t* a) {
+    num_value_t acc = op == ARRAY_ADD ? 0 : a[0];
+    switch(op) {
+        case ARRAY_ADD: for(int32_t i = 0; i < n; i++) acc += a[i]; break;
+        case ARRAY_MIN: for(int32_t i = 1; i < n; i++) acc = a[i] < acc ? a[i] : acc; break;
+        case ARRAY_MAX: for(int32_t i = 1; i < n; i++) acc = a[i] > acc ? a[i] : acc; break;
+        default: assert(0);
+    }
+    return acc;
+}
+
+static float_value_t float_fold(int8_t op, int32_t n, const float_value_t* a) {
+    /*
+        Floating point addition isn't associative, so the compiler won't
+        reorder a single accumulator into vector lanes by itself. Eight
+        independent partial sums give it (and the CPU) the lanes explicitly.
+    */
+    if(op == ARRAY_ADD) {
+        float_value_t partial[8] = { 0 };
+        int32_t i = 0;
+        for(; i + 8 <= n; i += 8) {
+            for(int32_t j = 0; j < 8; j++) partial[j] += a[i + j];
+        }
+        float_value_t acc = 0;
+        for(; i < n; i++) acc += a[i];
+        for(int32_t j = 0; j < 8; j++) acc += partial[j];
+        return acc;
+    }
+
+    float_value_t acc = a[0];
+    if(op == ARRAY_MIN) for(int32_t i = 1; i < n; i++) acc = a[i] < acc ? a[i] : acc;
+    else for(int32_t i = 1; i < n; i++) acc = a[i] > acc ? a[i] : acc;
+    return acc;
+}
+
+struct node_base* unboxed_array_fold(int8_t op, struct node_base* a) {
+    int32_t n = ((struct node_int_array*) a)->length;
+    if(n == 0 && op != ARRAY_ADD) {
+        fprintf(stderr, "Minimum or maximum of an empty array\n");
+        exit(1);
+    }
+
+    if(a->tag == NODE_INT_ARRAY) {
+        return (struct node_base*) alloc_num(int_fold(op, n, ((struct node_int_array*) a)->elements));
+    } else {
+        return (struct node_base*) alloc_float(float_fold(op, n, ((struct node_float_array*) a)->elements));
+    }
+}
+
+struct node_base* unboxed_array_dot(struct node_base* a, struct node_base* b) {
+    int32_t n = min_length(a, b);
+    if(a->tag == NODE_INT_ARRAY) {
+        const num_value_t* restrict x = ((struct node_int_array*) a)->elements;
+        const num_value_t* restrict y = ((struct node_int_array*) b)->elements;
+        num_value_t acc = 0;
+        for(int32_t i = 0; i < n; i++) acc += x[i] * y[i];
+        return (struct node_base*) alloc_num(acc);
+    }
+
+    const float_value_t* restrict x = ((struct node_float_array*) a)->elements;
+    const float_value_t* restrict y = ((struct node_float_array*) b)->elements;
+    float_value_t partial[8] = { 0 };
+    int32_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        for(int32_t j = 0; j < 8; j++) partial[j] += x[i + j] * y[i + j];
+    }
+    float_value_t acc = 0;
+    for(; i < n; i++) acc += x[i] * y[i];
+    for(int32_t j = 0; j < 8; j++) acc += partial[j];
+    return (struct node_base*) alloc_float(acc);
+}
+
+/*
+    Unboxed arrays are sorted with an LSD radix sort on keys that order the
+    same way as the elements when compared as unsigned integers: ints get
+    their sign bit flipped, floats get all bits flipped when negative and
+    only the sign bit otherwise. The same loop then sorts both kinds.
+*/
+#define SIGN_BIT ((num_bits_t) 1 << (sizeof(num_bits_t) * 8 - 1))
+
+static num_bits_t int_key(num_bits_t bits) { return bits ^ SIGN_BIT; }
+static num_bits_t int_unkey(num_bits_t key) { return key ^ SIGN_BIT; }
+static num_bits_t float_key(num_bits_t bits) { return bits ^ ((bits & SIGN_BIT) ? ~(num_bits_t) 0 : SIGN_BIT); }
+static num_bits_t float_unkey(num_bits_t key) { return key ^ ((key & SIGN_BIT) ? SIGN_BIT : ~(num_bits_t) 0); }
+
+static void radix_sort(num_bits_t* keys, num_bits_t* buffer, size_t n) {
+    for(size_t shift = 0; shift < sizeof(num_bits_t) * 8; shift += 8) {
+        size_t counts[257] = { 0 };
+        for(size_t i = 0; i < n; i++) counts[((keys[i] >> shift) & 0xFF) + 1]++;
+        if(counts[((keys[0] >> shift) & 0xFF) + 1] == n) continue; /* all equal in this digit */
+        for(int d = 0; d < 256; d++) counts[d + 1] += counts[d];
+        for(size_t i = 0; i < n; i++) buffer[counts[(keys[i] >> shift) & 0xFF]++] = keys[i];
+        memcpy(keys, buffer, sizeof(*keys) * n);
+    }
+}
+
+static void insertion_sort(num_bits_t* keys, size_t n) {
+    for(size_t i = 1; i < n; i++) {
+        num_bits_t key = keys[i];
+        size_t j = i;
+        for(; j > 0 && keys[j - 1] > key; j--) keys[j] = keys[j - 1];
+        keys[j] = key;
+    }
+}
+
+void unboxed_array_sort(struct node_base* a) {
+    struct node_int_array* array = (struct node_int_array*) a;
+    num_bits_t* keys = (num_bits_t*) array->elements;
+    size_t n = array->length;
+    int is_float = a->tag == NODE_FLOAT_ARRAY;
+
+    for(size_t i = 0; i < n; i++) keys[i] = is_float ? float_key(keys[i]) : int_key(keys[i]);
+    if(n <= 64) {
+        insertion_sort(keys, n);
+    } else {
+        num_bits_t* buffer = malloc(sizeof(*buffer) * n);
+        assert(buffer != NULL);
+        radix_sort(keys, buffer, n);
+        free(buffer);
+    }
+    for(size_t i = 0; i < n; i++) keys[i] = is_float ? float_unkey(keys[i]) : int_unkey(keys[i]);
+}
+
+int32_t unboxed_array_search(struct node_base* a, struct node_base* x) {
+    int32_t low = 0;
+    int32_t high = ((struct node_int_array*) a)->length;
+    if(a->tag == NODE_INT_ARRAY) {
+        const num_value_t* elements = ((struct node_int_array*) a)->elements;
+        num_value_t value = ((struct node_num*) x)->value;
+        while(low < high) {
+            int32_t mid = low + (high - low) / 2;
+            if(elements[mid] < value) low = mid + 1; else high = mid;
+        }
+    } else {
+        const float_value_t* elements = ((struct node_float_array*) a)->elements;
+        float_value_t value = node_float_value(x);
+        while(low < high) {
+            int32_t mid = low + (high - low) / 2;
+            if(elements[mid] < value) low = mid + 1; else high = mid;
+        }
+    }
+    return low;
+}
+
+int32_t unboxed_array_partition(struct node_base* a, struct node_base* x) {
+    int32_t n = ((struct node_int_array*) a)->length;
+    int32_t split = 0;
+    if(a->tag == NODE_INT_ARRAY) {
+        num_value_t* elements = ((struct node_int_array*) a)->elements;
+        num_value_t pivot = ((struct node_num*) x)->value;
+        for(int32_t i = 0; i < n; i++) {
+            if(elements[i] < pivot) {
+                num_value_t tmp = elements[i]; elements[i] = elements[split]; elements[split++] = tmp;
+            }
+        }
+    } else {
+        float_value_t* elements = ((struct node_float_array*) a)->elements;
+        float_value_t pivot = node_float_value(x);
+        for(int32_t i = 0; i < n; i++) {
+            if(elements[i] < pivot) {
+                float_value_t tmp = elements[i]; elements[i] = elements[split]; elements[split++] = tmp;
+            }
+        }
+    }
+    return split;
+}
+
 void free_node_direct(struct node_base* n) {
     if(n->tag == NODE_DATA) {
         free(((struct node_data*) n)->array);
@@ -74,6 +353,13 @@ void gc_visit_node(struct node_base* n) {
             gc_visit_node(*to_visit);
             to_visit++;
         }
+    } if(n->tag == NODE_VECTOR) {
+        gc_visit_node((struct node_base*) ((struct node_vector*) n)->root);
+    } if(n->tag == NODE_ARRAY) {
+        struct node_array* array = (struct node_array*) n;
+        for(int32_t i = 0; i < array->length; i++) {
+            gc_visit_node(array->elements[i]);
+        }
     }
 }
 
@@ -111,6 +397,14 @@ void stack_popn(struct stack* s, size_t n) {
     s->count -= n;
 }
 
+/* Statically allocated nodes (shared CAFs) that may point into the heap. */
+static struct stack gc_roots;
+
+void gc_register_root(struct node_base* n) {
+    if(gc_roots.data == NULL) stack_init(&gc_roots);
+    stack_push(&gc_roots, n);
+}
+
 void gmachine_init(struct gmachine* g) {
     stack_init(&g->stack);
     g->gc_nodes = NULL;
@@ -138,6 +432,13 @@ void gmachine_slide(struct gmachine* g, size_t n) {
     g->stack.count -= n;
 }
 
+void gmachine_slide_args(struct gmachine* g, size_t n, size_t o) {
+    assert(g->stack.count >= n + o);
+    memmove(&g->stack.data[g->stack.count - n - o],
+            &g->stack.data[g->stack.count - n], n * sizeof(*g->stack.data));
+    g->stack.count -= o;
+}
+
 void gmachine_update(struct gmachine* g, size_t o) {
     assert(g->stack.count > o + 1); // Verify enough elements
     struct node_ind* ind =
@@ -177,6 +478,573 @@ void gmachine_split(struct gmachine* g, size_t n) {
     }
 }
 
+void gmachine_array(struct gmachine* g) {
+    struct stack* s = &g->stack;
+    size_t capacity = 16;
+    size_t length = 0;
+    struct node_base** elements = malloc(sizeof(*elements) * capacity);
+    assert(elements != NULL);
+
+    /*
+        Walk the list with a cursor on top of the stack. The list itself stays
+        right below it, which keeps every element collected so far reachable
+        while evaluating the rest of the spine.
+    */
+    stack_push(s, stack_peek(s, 0));
+    while(1) {
+        unwind(g);
+        struct node_data* cell = (struct node_data*) stack_peek(s, 0);
+        if(cell->tag == 0) break; /* _Nil */
+
+        if(length == capacity) {
+            elements = realloc(elements, sizeof(*elements) * (capacity *= 2));
+            assert(elements != NULL);
+        }
+        assert(length < INT32_MAX);
+        elements[length++] = cell->array[1];
+        s->data[s->count - 1] = cell->array[0];
+    }
+
+    struct node_array* array = alloc_array(length);
+    memcpy(array->elements, elements, sizeof(*elements) * length);
+    free(elements);
+
+    stack_popn(s, 2);
+    stack_push(s, gmachine_track(g, (struct node_base*) array));
+}
+
+void gmachine_unboxed_array(struct gmachine* g, int8_t is_float) {
+    struct stack* s = &g->stack;
+    size_t capacity = 16;
+    size_t length = 0;
+    num_value_t* elements = malloc(sizeof(*elements) * capacity);
+    assert(elements != NULL);
+
+    /* As in gmachine_array, but each head is evaluated and its value copied out. */
+    stack_push(s, stack_peek(s, 0));
+    while(1) {
+        unwind(g);
+        struct node_data* cell = (struct node_data*) stack_peek(s, 0);
+        if(cell->tag == 0) break; /* _Nil */
+
+        stack_push(s, cell->array[1]);
+        unwind(g);
+        struct node_base* head = stack_pop(s);
+
+        if(length == capacity) {
+            elements = realloc(elements, sizeof(*elements) * (capacity *= 2));
+            assert(elements != NULL);
+        }
+        assert(length < INT32_MAX);
+        if(is_float) {
+            float_value_t value = node_float_value(head);
+            memcpy(&elements[length++], &value, sizeof(float_value_t));
+        } else {
+            elements[length++] = ((struct node_num*) head)->value;
+        }
+        s->data[s->count - 1] = cell->array[0];
+    }
+
+    struct node_base* array =
+        alloc_unboxed_array(is_float ? NODE_FLOAT_ARRAY : NODE_INT_ARRAY, length);
+    memcpy(((struct node_int_array*) array)->elements, elements, sizeof(*elements) * length);
+    free(elements);
+
+    stack_popn(s, 2);
+    stack_push(s, gmachine_track(g, array));
+}
+
+/*
+    Boxed arrays of numbers are sorted by first evaluating every element
+    (or its key) and then running a stable merge sort on (key, node) pairs.
+    Ints and floats both fit a sort_key exactly, so one key type covers both.
+*/
+#ifdef WIDE_NUMBERS
+typedef long double sort_key;
+#else
+typedef double sort_key;
+#endif
+
+struct keyed_node {
+    sort_key key;
+    struct node_base* node;
+};
+
+static sort_key node_key(struct node_base* n) {
+    if(n->tag == NODE_FLOAT) return ((struct node_float*) n)->value;
+    return ((struct node_num*) n)->value;
+}
+
+static void merge_sort(struct keyed_node* a, struct keyed_node* buffer, size_t n) {
+    if(n <= 16) {
+        for(size_t i = 1; i < n; i++) {
+            struct keyed_node item = a[i];
+            size_t j = i;
+            for(; j > 0 && a[j - 1].key > item.key; j--) a[j] = a[j - 1];
+            a[j] = item;
+        }
+        return;
+    }
+
+    size_t half = n / 2;
+    merge_sort(a, buffer, half);
+    merge_sort(a + half, buffer, n - half);
+    if(a[half - 1].key <= a[half].key) return;
+
+    memcpy(buffer, a, sizeof(*a) * half);
+    size_t i = 0, j = half, k = 0;
+    while(i < half && j < n) a[k++] = a[j].key < buffer[i].key ? a[j++] : buffer[i++];
+    while(i < half) a[k++] = buffer[i++];
+}
+
+static struct node_base* gmachine_eval_node(struct gmachine* g, struct node_base* n) {
+    stack_push(&g->stack, n);
+    unwind(g);
+    return stack_pop(&g->stack);
+}
+
+/* Evaluates the key of every element, which is f applied to it if f is given. */
+static struct keyed_node* gmachine_keys(struct gmachine* g, struct node_array* array, struct node_base* f) {
+    struct keyed_node* keys = malloc(sizeof(*keys) * (array->length + 1));
+    assert(keys != NULL);
+    for(int32_t i = 0; i < array->length; i++) {
+        if(f) {
+            struct node_base* app =
+                gmachine_track(g, (struct node_base*) alloc_app(f, array->elements[i]));
+            keys[i].node = array->elements[i];
+            keys[i].key = node_key(gmachine_eval_node(g, app));
+        } else {
+            keys[i].node = gmachine_eval_node(g, array->elements[i]);
+            keys[i].key = node_key(keys[i].node);
+        }
+    }
+    return keys;
+}
+
+void gmachine_sort(struct gmachine* g, struct node_base* f, struct node_base* a) {
+    struct node_array* array = (struct node_array*) a;
+    stack_push(&g->stack, f ? f : a);
+    stack_push(&g->stack, a);
+
+    struct keyed_node* keys = gmachine_keys(g, array, f);
+    struct keyed_node* buffer = malloc(sizeof(*buffer) * (array->length / 2 + 1));
+    assert(buffer != NULL);
+    merge_sort(keys, buffer, array->length);
+    for(int32_t i = 0; i < array->length; i++) array->elements[i] = keys[i].node;
+    free(buffer);
+    free(keys);
+
+    stack_popn(&g->stack, 2);
+}
+
+int32_t gmachine_search(struct gmachine* g, struct node_base* a, struct node_base* x) {
+    /* Only the elements the search probes are evaluated. */
+    struct node_array* array = (struct node_array*) a;
+    sort_key value = node_key(x);
+    int32_t low = 0;
+    int32_t high = array->length;
+
+    stack_push(&g->stack, a);
+    while(low < high) {
+        int32_t mid = low + (high - low) / 2;
+        struct node_base* element = gmachine_eval_node(g, array->elements[mid]);
+        array->elements[mid] = element;
+        if(node_key(element) < value) low = mid + 1; else high = mid;
+    }
+    stack_pop(&g->stack);
+    return low;
+}
+
+int32_t gmachine_partition(struct gmachine* g, struct node_base* a, struct node_base* x) {
+    struct node_array* array = (struct node_array*) a;
+    sort_key pivot = node_key(x);
+    int32_t split = 0;
+
+    stack_push(&g->stack, a);
+    for(int32_t i = 0; i < array->length; i++) {
+        struct node_base* element = gmachine_eval_node(g, array->elements[i]);
+        array->elements[i] = element;
+        if(node_key(element) < pivot) {
+            array->elements[i] = array->elements[split];
+            array->elements[split++] = element;
+        }
+    }
+    stack_pop(&g->stack);
+    return split;
+}
+
+/*
+    Vector operations allocate several nodes that only become reachable
+    once the new root is returned, so collection is paused while they run.
+*/
+static struct node_array* vector_node(struct gmachine* g, int32_t length) {
+    return (struct node_array*) gmachine_track(g, (struct node_base*) alloc_array(length));
+}
+
+static struct node_vector* vector_root(struct gmachine* g, int32_t length, int32_t shift, struct node_array* root) {
+    struct node_vector* vector = (struct node_vector*) alloc_node();
+    vector->base.tag = NODE_VECTOR;
+    vector->length = length;
+    vector->shift = shift;
+    vector->root = root;
+    return (struct node_vector*) gmachine_track(g, (struct node_base*) vector);
+}
+
+static struct node_array* vector_copy(struct gmachine* g, struct node_array* node, int32_t length) {
+    struct node_array* copy = vector_node(g, length);
+    memcpy(copy->elements, node->elements, sizeof(*node->elements) *
+            (node->length < length ? node->length : length));
+    return copy;
+}
+
+/* Builds a trie of the given shift over elements, with full subtries except the last. */
+static struct node_array* vector_build(struct gmachine* g, struct node_base** elements, int32_t length, int32_t shift) {
+    int32_t child_size = 1 << shift;
+    int32_t children = (length + child_size - 1) / child_size;
+    struct node_array* node = vector_node(g, children);
+    for(int32_t i = 0; i < children; i++) {
+        int32_t start = i * child_size;
+        int32_t count = length - start < child_size ? length - start : child_size;
+        node->elements[i] = shift == 0 ? elements[start] : (struct node_base*)
+            vector_build(g, elements + start, count, shift - VECTOR_BITS);
+    }
+    return node;
+}
+
+static int32_t vector_shift(int32_t length) {
+    int32_t shift = 0;
+    while(shift < 30 && ((int64_t) 1 << (shift + VECTOR_BITS)) < length) shift += VECTOR_BITS;
+    return shift;
+}
+
+void gmachine_vector(struct gmachine* g) {
+    gmachine_array(g);
+    struct node_array* array = (struct node_array*) stack_peek(&g->stack, 0);
+
+    int8_t gc_enabled = g->gc_enabled;
+    g->gc_enabled = 0;
+    int32_t shift = vector_shift(array->length);
+    struct node_vector* vector = vector_root(g, array->length, shift,
+            vector_build(g, array->elements, array->length, shift));
+    g->gc_enabled = gc_enabled;
+
+    g->stack.data[g->stack.count - 1] = (struct node_base*) vector;
+}
+
+static void vector_check(struct node_vector* vector, num_value_t index) {
+    if(index < 0 || index >= vector->length) array_bounds_error(index, vector->length);
+}
+
+struct node_base* vector_get(struct node_base* v, num_value_t index) {
+    struct node_vector* vector = (struct node_vector*) v;
+    vector_check(vector, index);
+    struct node_array* node = vector->root;
+    for(int32_t shift = vector->shift; shift > 0; shift -= VECTOR_BITS) {
+        node = (struct node_array*) node->elements[(index >> shift) & (VECTOR_WIDTH - 1)];
+    }
+    return node->elements[index & (VECTOR_WIDTH - 1)];
+}
+
+struct node_base* gmachine_vector_set(struct gmachine* g, struct node_base* v, num_value_t index, struct node_base* x) {
+    struct node_vector* vector = (struct node_vector*) v;
+    vector_check(vector, index);
+
+    int8_t gc_enabled = g->gc_enabled;
+    g->gc_enabled = 0;
+    struct node_array* root = vector_copy(g, vector->root, vector->root->length);
+    struct node_array* node = root;
+    for(int32_t shift = vector->shift; shift > 0; shift -= VECTOR_BITS) {
+        struct node_base** slot = &node->elements[(index >> shift) & (VECTOR_WIDTH - 1)];
+        struct node_array* child = (struct node_array*) *slot;
+        node = vector_copy(g, child, child->length);
+        *slot = (struct node_base*) node;
+    }
+    node->elements[index & (VECTOR_WIDTH - 1)] = x;
+    struct node_vector* result = vector_root(g, vector->length, vector->shift, root);
+    g->gc_enabled = gc_enabled;
+    return (struct node_base*) result;
+}
+
+/* Copies the path to the last element of node, with room for one more at the end. */
+static struct node_array* vector_append(struct gmachine* g, struct node_array* node, int32_t index, int32_t shift, struct node_base* x) {
+    int32_t slot = (index >> shift) & (VECTOR_WIDTH - 1);
+    struct node_array* copy = vector_copy(g, node, slot + 1);
+    if(shift == 0) {
+        copy->elements[slot] = x;
+    } else if(slot < node->length) {
+        copy->elements[slot] = (struct node_base*)
+            vector_append(g, (struct node_array*) node->elements[slot], index, shift - VECTOR_BITS, x);
+    } else {
+        struct node_base* leaf = x;
+        copy->elements[slot] = (struct node_base*) vector_build(g, &leaf, 1, shift - VECTOR_BITS);
+    }
+    return copy;
+}
+
+struct node_base* gmachine_vector_push(struct gmachine* g, struct node_base* v, struct node_base* x) {
+    struct node_vector* vector = (struct node_vector*) v;
+    assert(vector->length < INT32_MAX);
+
+    int8_t gc_enabled = g->gc_enabled;
+    g->gc_enabled = 0;
+    struct node_array* root;
+    int32_t shift = vector->shift;
+    if(vector->length > 0 && ((int64_t) vector->length >> shift) >= VECTOR_WIDTH) {
+        /* The trie is full: grow a level, with the old root as its first child. */
+        struct node_base* leaf = x;
+        root = vector_node(g, 2);
+        root->elements[0] = (struct node_base*) vector->root;
+        root->elements[1] = (struct node_base*) vector_build(g, &leaf, 1, shift);
+        shift += VECTOR_BITS;
+    } else {
+        root = vector_append(g, vector->root, vector->length, shift, x);
+    }
+    struct node_vector* result = vector_root(g, vector->length + 1, shift, root);
+    g->gc_enabled = gc_enabled;
+    return (struct node_base*) result;
+}
+
+struct node_base* gmachine_vector_replicate(struct gmachine* g, num_value_t length, struct node_base* x) {
+    if(length < 0) length = 0;
+    assert(length <= INT32_MAX);
+
+    /* Every full subtrie of the same height is identical, so they are shared. */
+    int8_t gc_enabled = g->gc_enabled;
+    g->gc_enabled = 0;
+    int32_t shift = vector_shift(length);
+    struct node_array* full = NULL;
+    struct node_array* root = NULL;
+    for(int32_t level = 0; level <= shift; level += VECTOR_BITS) {
+        int64_t child_size = (int64_t) 1 << level;
+        int32_t size = level == shift ? (int32_t) ((length + child_size - 1) / child_size) : VECTOR_WIDTH;
+        int32_t last_count = (int32_t) (length - (int64_t) (size - 1) * child_size);
+        struct node_array* node = vector_node(g, size);
+        for(int32_t i = 0; i < size; i++) {
+            node->elements[i] = level == 0 ? x : (struct node_base*) full;
+        }
+        if(level == shift) {
+            /* The last child of the root may be partial. */
+            if(size > 0 && level > 0 && last_count < child_size) {
+                struct node_base** leaves = malloc(sizeof(*leaves) * last_count);
+                assert(leaves != NULL);
+                for(int32_t i = 0; i < last_count; i++) leaves[i] = x;
+                node->elements[size - 1] = (struct node_base*)
+                    vector_build(g, leaves, last_count, level - VECTOR_BITS);
+                free(leaves);
+            }
+            root = node;
+        }
+        full = node;
+    }
+    struct node_vector* result = vector_root(g, length, shift, root);
+    g->gc_enabled = gc_enabled;
+    return (struct node_base*) result;
+}
+
+/*
+    Program output goes through one buffer that is flushed with write(2)
+    when it fills up, before input is read and when the program exits.
+*/
+static char output_buffer[1 << 16];
+static size_t output_used = 0;
+
+void output_flush() {
+    size_t written = 0;
+    while(written < output_used) {
+        ssize_t result = write(1, output_buffer + written, output_used - written);
+        if(result <= 0) break;
+        written += result;
+    }
+    output_used = 0;
+}
+
+static void output_bytes(const char* bytes, size_t n) {
+    if(output_used + n > sizeof(output_buffer)) output_flush();
+    memcpy(output_buffer + output_used, bytes, n);
+    output_used += n;
+}
+
+void output_int(num_value_t value) {
+    char digits[21];
+    char* end = digits + sizeof(digits);
+    char* start = end;
+    num_bits_t magnitude = value < 0 ? -(num_bits_t) value : (num_bits_t) value;
+    do {
+        *--start = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while(magnitude);
+    if(value < 0) *--start = '-';
+    output_bytes(start, end - start);
+}
+
+void output_float(float_value_t value) {
+    char text[32];
+    int precision = sizeof(float_value_t) == sizeof(float) ? 6 : 15;
+    int length = snprintf(text, sizeof(text), "%.*g", precision, (double) value);
+    output_bytes(text, length);
+}
+
+/*
+    Program input is read from stdin in large blocks. Output is flushed
+    before each block is read, so prompts appear before the program waits.
+    When stdin is a regular file, the rest of it is mapped instead, so
+    getContents can stream it without copying.
+*/
+static char input_buffer[1 << 16];
+static const char* input_data = input_buffer;
+static size_t input_start = 0;
+static size_t input_end = 0;
+static int input_probed = 0;
+static int input_mapped = 0;
+
+static int input_map() {
+    struct stat st;
+    if(fstat(0, &st) != 0 || !S_ISREG(st.st_mode)) return 0;
+    off_t offset = lseek(0, 0, SEEK_CUR);
+    if(offset < 0 || offset >= st.st_size) return 0;
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, 0, 0);
+    if(data == MAP_FAILED) return 0;
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    input_data = data;
+    input_start = offset;
+    input_end = st.st_size;
+    return 1;
+}
+
+static int input_peek() {
+    if(input_start == input_end) {
+        if(input_mapped) return EOF;
+        output_flush();
+        if(!input_probed) {
+            input_probed = 1;
+            input_mapped = input_map();
+            if(input_mapped) return (unsigned char) input_data[input_start];
+        }
+        ssize_t result = read(0, input_buffer, sizeof(input_buffer));
+        input_start = 0;
+        input_end = result > 0 ? result : 0;
+        if(input_end == 0) return EOF;
+    }
+    return (unsigned char) input_data[input_start];
+}
+
+int32_t input_char() {
+    int c = input_peek();
+    if(c != EOF) input_start++;
+    return c;
+}
+
+static int input_is_space(int c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static void input_skip_space() {
+    while(input_is_space(input_peek())) input_start++;
+}
+
+struct node_base* read_int() {
+    input_skip_space();
+    int negative = 0;
+    if(input_peek() == '-' || input_peek() == '+') negative = input_char() == '-';
+    num_bits_t value = 0;
+    int c;
+    while((c = input_peek()) >= '0' && c <= '9') {
+        value = value * 10 + (c - '0');
+        input_start++;
+    }
+    return (struct node_base*) alloc_num(negative ? -value : value);
+}
+
+struct node_base* read_float() {
+    char token[64];
+    size_t length = 0;
+    int c;
+    input_skip_space();
+    while((c = input_peek()) != EOF && !input_is_space(c)) {
+        if(length < sizeof(token) - 1) token[length++] = c;
+        input_start++;
+    }
+    token[length] = '\0';
+    return (struct node_base*) alloc_float(strtod(token, NULL));
+}
+
+static struct node_base* alloc_packed(struct gmachine* g, int8_t tag, struct node_base* tail, struct node_base* head) {
+    size_t n = head ? 2 : 0;
+    struct node_base** data = malloc(sizeof(*data) * (n + 1));
+    assert(data != NULL);
+    if(head) {
+        data[0] = tail;
+        data[1] = head;
+    }
+    data[n] = NULL;
+
+    struct node_data* node = (struct node_data*) alloc_node();
+    node->array = data;
+    node->base.tag = NODE_DATA;
+    node->tag = tag;
+    return gmachine_track(g, (struct node_base*) node);
+}
+
+/* Reads characters up to (and consuming) a delimiter into a List Char. */
+static struct node_base* gmachine_read_string(struct gmachine* g, int stop_at_space) {
+    size_t capacity = 64;
+    size_t length = 0;
+    char* text = malloc(capacity);
+    assert(text != NULL);
+
+    int c;
+    if(stop_at_space) input_skip_space();
+    while((c = input_char()) != EOF && c != '\n' && !(stop_at_space && input_is_space(c))) {
+        if(length == capacity) {
+            text = realloc(text, capacity *= 2);
+            assert(text != NULL);
+        }
+        text[length++] = c;
+    }
+    if(!stop_at_space && length > 0 && text[length - 1] == '\r') length--;
+
+    /* The list is built back to front and is unreachable until returned. */
+    int8_t gc_enabled = g->gc_enabled;
+    g->gc_enabled = 0;
+    struct node_base* list = alloc_packed(g, 0, NULL, NULL); /* _Nil */
+    while(length--) {
+        struct node_base* character = alloc_packed(g, text[length], NULL, NULL);
+        list = alloc_packed(g, 1, list, character); /* _Cons */
+    }
+    g->gc_enabled = gc_enabled;
+
+    free(text);
+    return list;
+}
+
+struct node_base* gmachine_read_line(struct gmachine* g) {
+    return gmachine_read_string(g, 0);
+}
+
+struct node_base* gmachine_read_word(struct gmachine* g) {
+    return gmachine_read_string(g, 1);
+}
+
+void gmachine_print(struct gmachine* g) {
+    /* Walks the string on top of the stack, replacing each cell by its tail as it goes. */
+    struct stack* s = &g->stack;
+    while(1) {
+        unwind(g);
+        struct node_data* cell = (struct node_data*) stack_peek(s, 0);
+        if(cell->tag == 0) break; /* _Nil */
+
+        stack_push(s, cell->array[1]);
+        unwind(g);
+        struct node_data* c = (struct node_data*) stack_pop(s);
+        if(output_used == sizeof(output_buffer)) output_flush();
+        output_buffer[output_used++] = c->tag;
+
+        s->data[s->count - 1] = cell->array[0];
+    }
+}
+
 void gmachine_enablegc(struct gmachine* g) {
     g->gc_enabled = 1;
 }
@@ -204,6 +1072,9 @@ void gmachine_gc(struct gmachine* g) {
     for(size_t i = 0; i < g->stack.count; i++) {
         gc_visit_node(g->stack.data[i]);
     }
+    for(size_t i = 0; i < gc_roots.count; i++) {
+        gc_visit_node(gc_roots.data[i]);
+    }
 
     struct node_base** head_ptr = &g->gc_nodes;
     while(*head_ptr) {
@@ -218,6 +1089,11 @@ void gmachine_gc(struct gmachine* g) {
             g->gc_node_count--;
         }
     }
+
+    /* Roots are not on the gc_nodes list, so the sweep doesn't reset them. */
+    for(size_t i = 0; i < gc_roots.count; i++) {
+        gc_roots.data[i]->gc_reachable = 0;
+    }
 }
 
 void unwind(struct gmachine* g) {
@@ -259,6 +1135,14 @@ void print_node(struct node_base* n) {
     } else if(n->tag == NODE_DATA) {
         struct node_data* data = (struct node_data*) n;
         printf("(Packed: tag = %d)", data->tag);
+    } else if(n->tag == NODE_ARRAY) {
+        struct node_array* array = (struct node_array*) n;
+        printf("(Array: length = %d)", array->length);
+    } else if(n->tag == NODE_VECTOR) {
+        printf("(Vector: length = %d)", ((struct node_vector*) n)->length);
+    } else if(n->tag == NODE_INT_ARRAY || n->tag == NODE_FLOAT_ARRAY) {
+        struct node_int_array* array = (struct node_int_array*) n;
+        printf("(%s: length = %d)", n->tag == NODE_INT_ARRAY ? "IntArray" : "FloatArray", array->length);
     } else if(n->tag == NODE_GLOBAL) {
         struct node_global* global = (struct node_global*) n;
         printf("(Global: %p)", global->function);
@@ -266,10 +1150,10 @@ void print_node(struct node_base* n) {
         print_node(((struct node_ind*) n)->next);
     } else if(n->tag == NODE_NUM) {
         struct node_num* num = (struct node_num*) n;
-        printf("%d", num->value);
+        printf("%lld", (long long) num->value);
     } else if(n->tag == NODE_FLOAT) {
         struct node_float* num = (struct node_float*) n;
-        printf("%f", num->value);
+        printf("%f", (double) num->value);
     }
 }
 
@@ -279,10 +1163,12 @@ int main(int argc, char** argv) {
     struct node_base* result;
 
     gmachine_init(&gmachine);
+    atexit(output_flush);
     gmachine_track(&gmachine, (struct node_base*) first_node);
     stack_push(&gmachine.stack, (struct node_base*) first_node);
     unwind(&gmachine);
     result = stack_pop(&gmachine.stack);
+    output_flush();
     printf("Result: ");
     print_node(result);
     putchar('\n');
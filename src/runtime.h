@@ -1,15 +1,43 @@
 #pragma once
+#include <stdint.h>
 #include <stdlib.h>
 
 struct gmachine;
 
+/*
+    The widths of Int and Float. Build the runtime with -DWIDE_NUMBERS
+    for programs compiled with --wide-numbers.
+*/
+#ifdef WIDE_NUMBERS
+typedef int64_t num_value_t;
+typedef uint64_t num_bits_t;
+typedef double float_value_t;
+#else
+typedef int32_t num_value_t;
+typedef uint32_t num_bits_t;
+typedef float float_value_t;
+#endif
+
 enum node_tag {
     NODE_APP,
     NODE_NUM,
     NODE_FLOAT,
     NODE_GLOBAL,
     NODE_IND,
-    NODE_DATA
+    NODE_DATA,
+    NODE_ARRAY,
+    NODE_INT_ARRAY,
+    NODE_FLOAT_ARRAY,
+    NODE_VECTOR
+};
+
+/* Element-wise and folding operations of the unboxed array kernels. */
+enum array_op {
+    ARRAY_ADD,
+    ARRAY_SUB,
+    ARRAY_MUL,
+    ARRAY_MIN,
+    ARRAY_MAX
 };
 
 struct node_base {
@@ -26,12 +54,12 @@ struct node_app {
 
 struct node_num {
     struct node_base base;
-    int32_t value;
+    num_value_t value;
 };
 
 struct node_float {
     struct node_base base;
-    float value;
+    float_value_t value;
 };
 
 struct node_global {
@@ -51,12 +79,55 @@ struct node_data {
     struct node_base** array;
 };
 
+struct node_array {
+    struct node_base base;
+    int32_t length;
+    struct node_base* elements[];
+};
+
+struct node_int_array {
+    struct node_base base;
+    int32_t length;
+    num_value_t elements[];
+};
+
+struct node_float_array {
+    struct node_base base;
+    int32_t length;
+    float_value_t elements[];
+};
+
+/*
+    A persistent vector: a trie of node_arrays with up to VECTOR_WIDTH
+    children each, whose leaves hold the elements. Updates copy one path.
+*/
+#define VECTOR_BITS 5
+#define VECTOR_WIDTH (1 << VECTOR_BITS)
+
+struct node_vector {
+    struct node_base base;
+    int32_t length;
+    int32_t shift;
+    struct node_array* root;
+};
+
 struct node_base* alloc_node();
 struct node_app* alloc_app(struct node_base* l, struct node_base* r);
-struct node_num* alloc_num(int32_t n);
-struct node_float* alloc_float(float n);
+struct node_num* alloc_num(num_value_t n);
+struct node_float* alloc_float(float_value_t n);
 struct node_global* alloc_global(void (*f)(struct gmachine*), int32_t a);
 struct node_ind* alloc_ind(struct node_base* n);
+struct node_array* alloc_array(int32_t length);
+void array_bounds_error(num_value_t index, int32_t length);
+struct node_base* alloc_unboxed_array(enum node_tag tag, int32_t length);
+
+struct node_base* unboxed_array_zip(int8_t op, struct node_base* a, struct node_base* b);
+struct node_base* unboxed_array_map(int8_t op, struct node_base* a, struct node_base* k);
+struct node_base* unboxed_array_fold(int8_t op, struct node_base* a);
+struct node_base* unboxed_array_dot(struct node_base* a, struct node_base* b);
+void unboxed_array_sort(struct node_base* a);
+int32_t unboxed_array_search(struct node_base* a, struct node_base* x);
+int32_t unboxed_array_partition(struct node_base* a, struct node_base* x);
 void free_node_direct(struct node_base*);
 void gc_visit_node(struct node_base*);
 
@@ -73,6 +144,15 @@ struct node_base* stack_pop(struct stack* s);
 struct node_base* stack_peek(struct stack* s, size_t o);
 void stack_popn(struct stack* s, size_t n);
 
+void gc_register_root(struct node_base* n);
+
+void output_flush();
+void output_int(num_value_t value);
+void output_float(float_value_t value);
+int32_t input_char();
+struct node_base* read_int();
+struct node_base* read_float();
+
 struct gmachine {
     struct stack stack;
     struct node_base* gc_nodes;
@@ -84,11 +164,26 @@ struct gmachine {
 void gmachine_init(struct gmachine* g);
 void gmachine_free(struct gmachine* g);
 void gmachine_slide(struct gmachine* g, size_t n);
+void gmachine_slide_args(struct gmachine* g, size_t n, size_t o);
 void gmachine_update(struct gmachine* g, size_t o);
 void gmachine_alloc(struct gmachine* g, size_t o);
 void gmachine_pack(struct gmachine* g, size_t n, int8_t t);
 void gmachine_split(struct gmachine* g, size_t n);
+void gmachine_array(struct gmachine* g);
+void gmachine_unboxed_array(struct gmachine* g, int8_t is_float);
+void gmachine_sort(struct gmachine* g, struct node_base* f, struct node_base* a);
+int32_t gmachine_search(struct gmachine* g, struct node_base* a, struct node_base* x);
+int32_t gmachine_partition(struct gmachine* g, struct node_base* a, struct node_base* x);
+void gmachine_print(struct gmachine* g);
+struct node_base* gmachine_read_line(struct gmachine* g);
+struct node_base* gmachine_read_word(struct gmachine* g);
+void gmachine_vector(struct gmachine* g);
+struct node_base* vector_get(struct node_base* v, num_value_t index);
+struct node_base* gmachine_vector_set(struct gmachine* g, struct node_base* v, num_value_t index, struct node_base* x);
+struct node_base* gmachine_vector_push(struct gmachine* g, struct node_base* v, struct node_base* x);
+struct node_base* gmachine_vector_replicate(struct gmachine* g, num_value_t length, struct node_base* x);
 void gmachine_enablegc(struct gmachine* g);
 void gmachine_disablegc(struct gmachine* g);
 struct node_base* gmachine_track(struct gmachine* g, struct node_base* b);
 void gmachine_gc(struct gmachine* g);
+void unwind(struct gmachine* g);
@@ -0,0 +1,58 @@
+#include "scheduler.hpp"
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+void run_dag(const std::vector<std::vector<size_t>>& dependencies, int jobs,
+        const std::function<void(size_t, int)>& task) {
+    size_t count = dependencies.size();
+    std::vector<std::vector<size_t>> dependents(count);
+    std::vector<size_t> waiting(count);
+    std::vector<size_t> ready;
+    for(size_t node = 0; node < count; node++) {
+        waiting[node] = dependencies[node].size();
+        for(size_t dependency : dependencies[node]) dependents[dependency].push_back(node);
+        if(waiting[node] == 0) ready.push_back(node);
+    }
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    size_t finished = 0;
+    std::exception_ptr error;
+
+    auto work = [&](int worker) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(true) {
+            wake.wait(lock, [&] { return !ready.empty() || error || finished == count; });
+            if(error || finished == count) return;
+            size_t node = ready.back();
+            ready.pop_back();
+
+            lock.unlock();
+            std::exception_ptr thrown;
+            try {
+                task(node, worker);
+            } catch(...) {
+                thrown = std::current_exception();
+            }
+            lock.lock();
+
+            if(thrown) {
+                if(!error) error = thrown;
+            } else {
+                finished++;
+                for(size_t dependent : dependents[node]) {
+                    if(--waiting[dependent] == 0) ready.push_back(dependent);
+                }
+            }
+            wake.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for(int worker = 1; worker < jobs; worker++) threads.emplace_back(work, worker);
+    work(0);
+    for(auto& thread : threads) thread.join();
+    if(error) std::rethrow_exception(error);
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Runs task(node, worker) for every node of a DAG on jobs threads (worker is
+// in [0, jobs), and 0 is the calling thread), starting a node only once every
+// node in its dependencies has finished. After a task throws, no new nodes are
+// started, and the first exception is rethrown once the running ones return.
+void run_dag(const std::vector<std::vector<size_t>>& dependencies, int jobs,
+        const std::function<void(size_t, int)>& task);
@@ -0,0 +1,179 @@
+#include "specialize.hpp"
+#include <queue>
+#include <set>
+#include <vector>
+#include "ast.hpp"
+
+struct specializer {
+    std::map<std::string, definition_defn_ptr>& defs_defn;
+    type_mgr& mgr;
+    const type_env_ptr& env;
+    std::map<std::string, definition_defn_ptr> created;
+    std::queue<std::pair<definition_defn*, std::map<std::string, num_kind>>> worklist;
+
+    specializer(std::map<std::string, definition_defn_ptr>& d, type_mgr& m, const type_env_ptr& e)
+        : defs_defn(d), mgr(m), env(e) {}
+
+    num_kind resolve_kind(type_ptr t, const std::map<std::string, num_kind>& subst,
+            const std::set<std::string>& generic) const;
+    void match(type_ptr scheme_type, type_ptr instance_type,
+            const std::set<std::string>& vars, std::map<std::string, type_ptr>& into) const;
+    std::string instance_name(const std::string& name, const type_ptr& instance_type,
+            const std::map<std::string, num_kind>& subst, const std::set<std::string>& generic);
+    void specialize(ast_ptr& a, const std::set<std::string>& scope,
+            const std::map<std::string, num_kind>& subst, const std::set<std::string>& generic);
+};
+
+// Num types are applications of a Num variable, Int or Float to no arguments.
+num_kind specializer::resolve_kind(type_ptr t, const std::map<std::string, num_kind>& subst,
+        const std::set<std::string>& generic) const {
+    type_var* var;
+    t = mgr.resolve(t, var);
+    if(type_app* app = type_cast<type_app>(t.get())) t = mgr.resolve(app->constructor, var);
+
+    if(var) {
+        auto found = subst.find(var->name);
+        if(found != subst.end()) return found->second;
+        // A variable that is not generalized is never instantiated with Float: its values
+        // only come from integer literals and Num-returning builtins, so default it to Int.
+        return generic.count(var->name) ? NUM_GENERIC : NUM_INT;
+    }
+    if(type_base* base = type_cast<type_base>(t.get())) {
+        if(base->name == "Int") return NUM_INT;
+        if(base->name == "Float") return NUM_FLOAT;
+    }
+    return NUM_GENERIC;
+}
+
+// Finds what each of the quantified vars was instantiated with.
+void specializer::match(type_ptr scheme_type, type_ptr instance_type,
+        const std::set<std::string>& vars, std::map<std::string, type_ptr>& into) const {
+    type_var* var;
+    scheme_type = mgr.resolve(scheme_type, var);
+    if(var) {
+        if(vars.count(var->name)) into.emplace(var->name, instance_type);
+        return;
+    }
+    instance_type = mgr.resolve(instance_type, var);
+    if(var) return;
+
+    type_arr* scheme_arr = type_cast<type_arr>(scheme_type.get());
+    type_arr* instance_arr = type_cast<type_arr>(instance_type.get());
+    type_app* scheme_app = type_cast<type_app>(scheme_type.get());
+    type_app* instance_app = type_cast<type_app>(instance_type.get());
+    if(scheme_arr && instance_arr) {
+        match(scheme_arr->left, instance_arr->left, vars, into);
+        match(scheme_arr->right, instance_arr->right, vars, into);
+    } else if(scheme_app && instance_app) {
+        match(scheme_app->constructor, instance_app->constructor, vars, into);
+        for(size_t i = 0; i < scheme_app->arguments.size() && i < instance_app->arguments.size(); i++) {
+            match(scheme_app->arguments[i], instance_app->arguments[i], vars, into);
+        }
+    }
+}
+
+// The name of the specialization a reference should use, creating it if needed,
+// or an empty string if the reference stays generic.
+std::string specializer::instance_name(const std::string& name, const type_ptr& instance_type,
+        const std::map<std::string, num_kind>& subst, const std::set<std::string>& generic) {
+    type_scheme_ptr scheme = env->lookup(name);
+    std::set<std::string> num_vars;
+    for(auto& var : scheme->forall) {
+        if(var.second) num_vars.insert(var.first);
+    }
+    if(num_vars.empty() || !instance_type) return "";
+
+    std::map<std::string, type_ptr> instances;
+    match(scheme->monotype, instance_type, num_vars, instances);
+
+    std::string new_name = name;
+    std::map<std::string, num_kind> new_subst;
+    for(auto& var : scheme->forall) {
+        if(!var.second) continue;
+        auto instance = instances.find(var.first);
+        if(instance == instances.end()) return "";
+        num_kind kind = resolve_kind(instance->second, subst, generic);
+        if(kind == NUM_GENERIC) return "";
+        new_name += num_kind_suffix(kind);
+        new_subst[var.first] = kind;
+    }
+
+    if(!created.count(new_name)) {
+        definition_defn* def = defs_defn.at(name).get();
+        definition_defn* new_def = new definition_defn(new_name, def->params, def->body->clone());
+        new_def->env = def->env;
+        new_def->var_env = def->var_env;
+        new_def->free_variables = def->free_variables;
+        new_def->full_type = def->full_type;
+        new_def->return_type = def->return_type;
+        new_def->caf = def->caf;
+        created[new_name] = definition_defn_ptr(new_def);
+        worklist.emplace(new_def, std::move(new_subst));
+    }
+    return new_name;
+}
+
+void specializer::specialize(ast_ptr& a, const std::set<std::string>& scope,
+        const std::map<std::string, num_kind>& subst, const std::set<std::string>& generic) {
+    if(ast_lid* lid = dynamic_cast<ast_lid*>(a.get())) {
+        if(!scope.count(lid->id) && defs_defn.count(lid->id)) {
+            std::string new_name = instance_name(lid->id, lid->instance_type, subst, generic);
+            if(!new_name.empty()) lid->id = new_name;
+        }
+    } else if(ast_int* num = dynamic_cast<ast_int*>(a.get())) {
+        num->as_float = resolve_kind(num->num_type, subst, generic) == NUM_FLOAT;
+    } else if(ast_binop* binop = dynamic_cast<ast_binop*>(a.get())) {
+        if(binop_is_num(binop->op)) binop->kind = resolve_kind(binop->operand_type, subst, generic);
+    } else if(ast_uniop* uniop = dynamic_cast<ast_uniop*>(a.get())) {
+        if(uniop->op == NEGATE) uniop->kind = resolve_kind(uniop->operand_type, subst, generic);
+    }
+
+    for_each_child(a, [&](ast_ptr& child, const std::vector<std::string>& names) {
+        std::set<std::string> child_scope = scope;
+        child_scope.insert(names.begin(), names.end());
+        specialize(child, child_scope, subst, generic);
+    });
+}
+
+void specialize_program(std::map<std::string, definition_defn_ptr>& defs_defn,
+        type_mgr& mgr, const type_env_ptr& env, std::ostream& log) {
+    specializer pass(defs_defn, mgr, env);
+
+    // The original definitions stay generic in their own Num variables, for uses we cannot resolve.
+    for(auto& def_defn : defs_defn) {
+        auto& def = def_defn.second;
+        std::set<std::string> generic;
+        for(auto& var : env->lookup(def->name)->forall) {
+            if(var.second) generic.insert(var.first);
+        }
+        pass.specialize(def->body, std::set<std::string>(def->params.begin(), def->params.end()),
+                std::map<std::string, num_kind>(), generic);
+    }
+    while(!pass.worklist.empty()) {
+        auto item = std::move(pass.worklist.front());
+        pass.worklist.pop();
+        auto def = item.first;
+        pass.specialize(def->body, std::set<std::string>(def->params.begin(), def->params.end()),
+                item.second, std::set<std::string>());
+    }
+
+    for(auto& new_def : pass.created) {
+        log << new_def.first << "\n";
+        defs_defn[new_def.first] = std::move(new_def.second);
+    }
+
+    for(auto& def_defn : defs_defn) {
+        auto& def = def_defn.second;
+        def->free_variables.clear();
+        find_free_lids(def->body, std::set<std::string>(def->params.begin(), def->params.end()), def->free_variables);
+    }
+
+    // Generic versions nobody else refers to anymore are dropped.
+    auto removed = remove_unreferenced(defs_defn, [&](const definition_defn& def) {
+        if(def.name == "main" || def.exported || pass.created.count(def.name)) return false;
+        bool num_polymorphic = false;
+        for(auto& var : env->lookup(def.name)->forall) num_polymorphic |= var.second;
+        return num_polymorphic;
+    });
+    for(auto& name : removed) log << name << " removed\n";
+}
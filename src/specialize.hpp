@@ -0,0 +1,13 @@
+#pragma once
+#include <map>
+#include <ostream>
+#include <string>
+#include "definition.hpp"
+#include "type.hpp"
+#include "type_env.hpp"
+
+// Clones Num-polymorphic definitions per concrete instantiation (name_Int, name_Float, ...)
+// and picks int or float arithmetic for every Num operator whose type is known.
+// Must run right after typechecking, before anything rewrites the AST.
+void specialize_program(std::map<std::string, definition_defn_ptr>& defs_defn,
+        type_mgr& mgr, const type_env_ptr& env, std::ostream& log);
@@ -0,0 +1,34 @@
+#include "timer.hpp"
+#include <iomanip>
+#include <sys/resource.h>
+
+static long peak_rss() {
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return usage.ru_maxrss;  // KiB on Linux
+}
+
+void time_report::print(std::ostream& to) const {
+    double total = 0;
+    to << "=== Compile time report ===" << std::endl;
+    to << std::left << std::setw(14) << "Phase" << std::right
+        << std::setw(12) << "Wall (s)" << std::setw(18) << "Peak RSS (MiB)" << std::endl;
+    for(auto& phase : phases) {
+        to << std::left << std::setw(14) << phase.name << std::right << std::fixed
+            << std::setw(12) << std::setprecision(4) << phase.seconds
+            << std::setw(18) << std::setprecision(1) << phase.peak_rss / 1024.0 << std::endl;
+        total += phase.seconds;
+    }
+    to << std::left << std::setw(14) << "total" << std::right << std::fixed
+        << std::setw(12) << std::setprecision(4) << total << std::endl;
+    to << std::defaultfloat << std::setprecision(6);
+}
+
+phase_timer::phase_timer(time_report* r, std::string n)
+    : report(r), name(std::move(n)), start(std::chrono::steady_clock::now()) {}
+
+phase_timer::~phase_timer() {
+    if(!report) return;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    report->phases.push_back({ std::move(name), elapsed.count(), peak_rss() });
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// The wall time and peak resident memory of the compiler's phases, for --time-report.
+struct time_report {
+    struct phase {
+        std::string name;
+        double seconds;
+        // The peak of the whole process so far, in KiB, as the phase ends.
+        long peak_rss;
+    };
+
+    std::vector<phase> phases;
+
+    void print(std::ostream& to) const;
+};
+
+// Adds the phase it lives through to report, unless report is null.
+struct phase_timer {
+    time_report* report;
+    std::string name;
+    std::chrono::steady_clock::time_point start;
+
+    phase_timer(time_report* r, std::string n);
+    ~phase_timer();
+};
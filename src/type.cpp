@@ -1,4 +1,5 @@
 #include "type.hpp"
+#include <cstdint>
 #include <ostream>
 #include <sstream>
 #include <algorithm>
@@ -19,17 +20,92 @@ void type_scheme::print(const type_mgr& mgr, std::ostream& to) const {
 
 type_ptr type_scheme::instantiate(type_mgr& mgr) const {
     if(forall.size() == 0) return monotype;
-    std::map<std::string, type_ptr> subst;
+    {
+        std::lock_guard<std::mutex> lock(steps_mutex);
+        if(steps.empty() || steps_forall != forall.size()) {
+            std::map<std::string, int> indices;
+            for(size_t i = 0; i < forall.size(); i++) indices[forall[i].first] = i;
+            steps.clear();
+            build_steps(mgr, monotype, indices);
+            steps_forall = forall.size();
+        }
+    }
+
+    std::vector<type_ptr> fresh;
+    fresh.reserve(forall.size());
     for(auto& var : forall) {
-        subst[var.first] = var.second ? mgr.new_num_type() : mgr.new_type();
+        fresh.push_back(var.second ? mgr.new_num_type() : mgr.new_type());
+    }
+
+    std::vector<type_ptr> results;
+    results.reserve(steps.size());
+    for(auto& step : steps) {
+        switch(step.op) {
+            case instantiate_step::FRESH:
+                results.push_back(fresh[step.index]);
+                break;
+            case instantiate_step::ARROW: {
+                type_ptr right = std::move(results.back());
+                results.pop_back();
+                results.back() = mgr.new_arr(std::move(results.back()), std::move(right));
+                break;
+            }
+            case instantiate_step::APPLY: {
+                auto first = results.end() - step.index - 1;
+                std::vector<type_ptr> arguments(std::make_move_iterator(first + 1), std::make_move_iterator(results.end()));
+                results.erase(first + 1, results.end());
+                *first = mgr.new_app(std::move(*first), std::move(arguments));
+                break;
+            }
+            case instantiate_step::SHARE:
+                results.push_back(step.shared);
+                break;
+        }
     }
-    return mgr.substitute(subst, monotype);
+    return std::move(results.back());
+}
+
+// Appends the steps for t and returns whether it contains a quantified variable.
+// Like substitute, this looks a variable's name up before and after resolving it.
+bool type_scheme::build_steps(const type_mgr& mgr, const type_ptr& t,
+        const std::map<std::string, int>& indices) const {
+    type_ptr resolved = t;
+    if(t->kind == TYPE_VAR) {
+        type_var* var = static_cast<type_var*>(t.get());
+        auto it = indices.find(var->name);
+        if(it == indices.end()) {
+            resolved = mgr.resolve(t, var);
+            if(var) it = indices.find(var->name);
+        }
+        if(it != indices.end()) {
+            steps.push_back(instantiate_step { instantiate_step::FRESH, it->second, nullptr });
+            return true;
+        }
+    }
+
+    size_t start = steps.size();
+    bool quantified = false;
+    if(type_arr* arr = type_cast<type_arr>(resolved.get())) {
+        quantified |= build_steps(mgr, arr->left, indices);
+        quantified |= build_steps(mgr, arr->right, indices);
+        if(quantified) steps.push_back(instantiate_step { instantiate_step::ARROW, 0, nullptr });
+    } else if(type_app* app = type_cast<type_app>(resolved.get())) {
+        quantified |= build_steps(mgr, app->constructor, indices);
+        for(auto& arg : app->arguments) quantified |= build_steps(mgr, arg, indices);
+        if(quantified) steps.push_back(instantiate_step { instantiate_step::APPLY, (int) app->arguments.size(), nullptr });
+    }
+
+    if(!quantified) {
+        steps.resize(start);
+        steps.push_back(instantiate_step { instantiate_step::SHARE, 0, mgr.intern(t) });
+    }
+    return quantified;
 }
 
 void type_var::print(const type_mgr& mgr, std::ostream& to) const {
-    auto it = mgr.types.find(name);
-    if(it != mgr.types.end()) {
-        it->second->print(mgr, to);
+    type_ptr resolved = mgr.lookup(this);
+    if(resolved && resolved.get() != this) {
+        resolved->print(mgr, to);
     } else {
         to << name;
     }
@@ -59,8 +135,15 @@ void type_app::print(const type_mgr& mgr, std::ostream& to) const {
     }
 }
 
-std::string type_mgr::new_type_name() {
-    int temp = last_id++;
+type_mgr type_mgr::fork() const {
+    type_mgr forked;
+    forked.table = table;
+    forked.nodes = nodes;
+    return forked;
+}
+
+std::string type_mgr::type_name(int id) {
+    int temp = id;
     std::string str = "_";
 
     while(temp != -1) {
@@ -73,72 +156,260 @@ std::string type_mgr::new_type_name() {
 }
 
 type_ptr type_mgr::new_type() {
-    return type_ptr(new type_var(new_type_name()));
+    int id = new_id();
+    type_ptr var = type_ptr(new type_var(type_name(id)));
+    add_var(id, var);
+    return var;
 }
 
 type_ptr type_mgr::new_num_type() {
-    auto type_num_var = new type_var(new_type_name());
+    int id = new_id();
+    auto type_num_var = new type_var(type_name(id));
     type_num_var->set_num_type();
-    return type_ptr(type_num_var);
+    type_ptr var = type_ptr(type_num_var);
+    add_var(id, var);
+    return var;
+}
+
+type_mgr::var_entry& type_mgr::entry(int id) const {
+    return table->blocks[id >> var_table::block_bits][id & ((1 << var_table::block_bits) - 1)];
+}
+
+int type_mgr::new_id() const {
+    if(next_id == block_end) {
+        std::lock_guard<std::mutex> lock(table->blocks_mutex);
+        if(table->blocks.size() == var_table::max_blocks)
+            throw unexpected_error("type_mgr::new_id: too many type variables.");
+        next_id = table->blocks.size() << var_table::block_bits;
+        block_end = next_id + (1 << var_table::block_bits);
+        table->blocks.emplace_back(new var_entry[1 << var_table::block_bits]);
+    }
+    return next_id++;
+}
+
+void type_mgr::add_var(int id, type_ptr v) const {
+    type_var* var = static_cast<type_var*>(v.get());
+    entry(id) = var_entry { id, 0, nullptr, std::move(v) };
+    var->id.store(id, std::memory_order_release);
+}
+
+int type_mgr::var_id(const type_ptr& t, type_var* v) const {
+    int id = v->id.load(std::memory_order_acquire);
+    if(id >= 0) return id;
+    std::lock_guard<std::mutex> lock(table->named_mutex);
+    auto it = table->named_vars.find(v->name);
+    if(it != table->named_vars.end()) {
+        v->id.store(it->second, std::memory_order_release);
+        return it->second;
+    }
+    id = new_id();
+    add_var(id, t);
+    return table->named_vars[v->name] = id;
+}
+
+int type_mgr::find(int id) const {
+    int root = id;
+    while(entry(root).parent != root) root = entry(root).parent;
+    while(entry(id).parent != root) {
+        int next = entry(id).parent;
+        entry(id).parent = root;
+        id = next;
+    }
+    return root;
+}
+
+type_ptr type_mgr::lookup(const type_var* v) const {
+    int id = v->id.load(std::memory_order_acquire);
+    if(id < 0) {
+        std::lock_guard<std::mutex> lock(table->named_mutex);
+        auto it = table->named_vars.find(v->name);
+        if(it == table->named_vars.end()) return nullptr;
+        id = it->second;
+    }
+    const var_entry& root = entry(find(id));
+    return root.binding ? root.binding : root.var;
 }
 
 type_ptr type_mgr::new_arrow_type() {
-    return type_ptr(new type_arr(new_type(), new_type()));
+    return new_arr(new_type(), new_type());
 }
 
-type_ptr type_mgr::resolve(type_ptr t, type_var*& var) const {
-    type_var* cast;
+static size_t hash_child(size_t hash, const type* child) {
+    return (hash ^ (reinterpret_cast<uintptr_t>(child) >> 4)) * 0x9e3779b97f4a7c15ull;
+}
 
-    var = nullptr;
-    while((cast = dynamic_cast<type_var*>(t.get()))) {
-        auto it = types.find(cast->name);
+size_t type_mgr::node_table::key_hash::operator()(const std::pair<const type*, const type*>& key) const {
+    return hash_child(hash_child(0, key.first), key.second);
+}
 
-        if(it == types.end()) {
-            var = cast;
-            break;
+size_t type_mgr::node_table::key_hash::operator()(const std::vector<const type*>& key) const {
+    size_t hash = key.size();
+    for(const type* child : key) hash = hash_child(hash, child);
+    return hash;
+}
+
+// Base types are the only leaves without variables.
+static bool is_ground(const type_ptr& t) {
+    return t->kind == TYPE_BASE || t->kind == TYPE_DATA || t->interned;
+}
+
+// The shard is picked with the high bits, which the hash's last multiplication mixes best.
+static type_mgr::node_table::shard& shard_for(type_mgr::node_table& nodes, size_t hash) {
+    return nodes.shards[(hash >> 32) % type_mgr::node_table::shard_count];
+}
+
+type_ptr type_mgr::new_arr(type_ptr left, type_ptr right) const {
+    if(!is_ground(left) || !is_ground(right)) {
+        return std::make_shared<type_arr>(std::move(left), std::move(right));
+    }
+    std::pair<const type*, const type*> key(left.get(), right.get());
+    auto& shard = shard_for(*nodes, node_table::key_hash()(key));
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    type_ptr& node = shard.arrows[key];
+    if(!node) {
+        node = std::make_shared<type_arr>(std::move(left), std::move(right));
+        node->interned = true;
+    }
+    return node;
+}
+
+type_ptr type_mgr::new_app(type_ptr constructor, std::vector<type_ptr> arguments) const {
+    bool ground = is_ground(constructor);
+    for(auto& argument : arguments) ground &= is_ground(argument);
+    if(!ground) {
+        auto app = std::make_shared<type_app>(std::move(constructor));
+        app->arguments = std::move(arguments);
+        return app;
+    }
+
+    std::vector<const type*> key { constructor.get() };
+    for(auto& argument : arguments) key.push_back(argument.get());
+    auto& shard = shard_for(*nodes, node_table::key_hash()(key));
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    type_ptr& node = shard.apps[std::move(key)];
+    if(!node) {
+        auto app = std::make_shared<type_app>(std::move(constructor));
+        app->arguments = std::move(arguments);
+        app->interned = true;
+        node = std::move(app);
+    }
+    return node;
+}
+
+type_ptr type_mgr::intern(const type_ptr& t) const {
+    if(t->interned) return t;
+    switch(t->kind) {
+        case TYPE_ARR: {
+            type_arr* arr = static_cast<type_arr*>(t.get());
+            return new_arr(intern(arr->left), intern(arr->right));
+        }
+        case TYPE_APP: {
+            type_app* app = static_cast<type_app*>(t.get());
+            std::vector<type_ptr> arguments;
+            arguments.reserve(app->arguments.size());
+            for(auto& argument : app->arguments) arguments.push_back(intern(argument));
+            return new_app(intern(app->constructor), std::move(arguments));
         }
-        t = it->second;
+        default:
+            return t;
     }
+}
+
+type_ptr type_mgr::resolve(type_ptr t, type_var*& var) const {
+    var = nullptr;
+    if(t->kind != TYPE_VAR) return t;
 
-    return t;
+    // Bindings are never variables, so one lookup reaches the end of the chain.
+    const var_entry& root = entry(find(var_id(t, static_cast<type_var*>(t.get()))));
+    if(root.binding) return root.binding;
+    var = static_cast<type_var*>(root.var.get());
+    return root.var;
+}
+
+type_ptr type_mgr::expand(const type_ptr& t) const {
+    type_var* var;
+    type_ptr resolved = resolve(t, var);
+    if(var) return resolved;
+
+    switch(resolved->kind) {
+        case TYPE_ARR: {
+            type_arr* arr = static_cast<type_arr*>(resolved.get());
+            auto left_result = expand(arr->left);
+            auto right_result = expand(arr->right);
+            if(left_result == arr->left && right_result == arr->right) return resolved;
+            return new_arr(std::move(left_result), std::move(right_result));
+        }
+        case TYPE_APP: {
+            type_app* app = static_cast<type_app*>(resolved.get());
+            type_ptr constructor = expand(app->constructor);
+            bool changed = constructor != app->constructor;
+            std::vector<type_ptr> arguments;
+            arguments.reserve(app->arguments.size());
+            for(auto& arg : app->arguments) {
+                arguments.push_back(expand(arg));
+                changed |= arguments.back() != arg;
+            }
+            return changed ? new_app(std::move(constructor), std::move(arguments)) : resolved;
+        }
+        default:
+            return resolved;
+    }
 }
 
 void type_mgr::unify(type_ptr l, type_ptr r) {
     type_var *lvar, *rvar;
-    type_arr *larr, *rarr;
-    type_base *lid, *rid;
-    type_app *lapp, *rapp;
 
     l = resolve(l, lvar);
     r = resolve(r, rvar);
+    // Equal types without variables are usually the same node, see type_mgr::node_table.
+    if(l == r) return;
 
     if(lvar) {
         if (bind(lvar, r)) return;
+        throw unification_error(l, r);
     } else if(rvar) {
         if (bind(rvar, l)) return;
-    } else if((larr = dynamic_cast<type_arr*>(l.get())) &&
-            (rarr = dynamic_cast<type_arr*>(r.get()))) {
-        unify(larr->left, rarr->left);
-        unify(larr->right, rarr->right);
-        return;
-    } else if((lid = dynamic_cast<type_base*>(l.get())) &&
-            (rid = dynamic_cast<type_base*>(r.get()))) {
-        if(lid->name == rid->name && lid->arity == rid->arity) return;
-    } else if((lapp = dynamic_cast<type_app*>(l.get())) &&
-            (rapp = dynamic_cast<type_app*>(r.get()))) {
-        unify(lapp->constructor, rapp->constructor);
-        auto left_it = lapp->arguments.begin();
-        auto right_it = rapp->arguments.begin();
-        while(left_it != lapp->arguments.end() &&
-                right_it != rapp->arguments.end()) {
-            unify(*left_it, *right_it);
-            left_it++, right_it++;
-        }
-        // Not sure whether this is needed.
-        if (left_it != lapp->arguments.end() ||
-                right_it != rapp->arguments.end())
-            throw unification_error(l, r);
-        return;
+        throw unification_error(l, r);
+    }
+
+    // type_data is a type_base, and the two unify by name like any other base types.
+    type_kind lkind = l->kind == TYPE_DATA ? TYPE_BASE : l->kind;
+    type_kind rkind = r->kind == TYPE_DATA ? TYPE_BASE : r->kind;
+    if(lkind != rkind) throw unification_error(l, r);
+
+    switch(lkind) {
+        case TYPE_ARR: {
+            type_arr* larr = static_cast<type_arr*>(l.get());
+            type_arr* rarr = static_cast<type_arr*>(r.get());
+            unify(larr->left, rarr->left);
+            unify(larr->right, rarr->right);
+            return;
+        }
+        case TYPE_BASE: {
+            type_base* lid = static_cast<type_base*>(l.get());
+            type_base* rid = static_cast<type_base*>(r.get());
+            if(lid->name == rid->name && lid->arity == rid->arity) return;
+            break;
+        }
+        case TYPE_APP: {
+            type_app* lapp = static_cast<type_app*>(l.get());
+            type_app* rapp = static_cast<type_app*>(r.get());
+            unify(lapp->constructor, rapp->constructor);
+            auto left_it = lapp->arguments.begin();
+            auto right_it = rapp->arguments.begin();
+            while(left_it != lapp->arguments.end() &&
+                    right_it != rapp->arguments.end()) {
+                unify(*left_it, *right_it);
+                left_it++, right_it++;
+            }
+            // Not sure whether this is needed.
+            if (left_it != lapp->arguments.end() ||
+                    right_it != rapp->arguments.end())
+                throw unification_error(l, r);
+            return;
+        }
+        default:
+            break;
     }
 
     throw unification_error(l, r);
@@ -146,52 +417,80 @@ void type_mgr::unify(type_ptr l, type_ptr r) {
 
 type_ptr type_mgr::substitute(const std::map<std::string, type_ptr>& subst, const type_ptr& t) const {
     type_ptr temp = t;
-    while(type_var* var = dynamic_cast<type_var*>(temp.get())) {
+    if(t->kind == TYPE_VAR) {
+        type_var* var = static_cast<type_var*>(t.get());
         auto subst_it = subst.find(var->name);
         if(subst_it != subst.end()) return subst_it->second;
-        auto var_it = types.find(var->name);
-        if(var_it == types.end()) return t;
-        temp = var_it->second;
+        temp = resolve(t, var);
+        if(var) {
+            subst_it = subst.find(var->name);
+            return subst_it != subst.end() ? subst_it->second : t;
+        }
     }
 
-    if(type_arr* arr = dynamic_cast<type_arr*>(temp.get())) {
-        auto left_result = substitute(subst, arr->left);
-        auto right_result = substitute(subst, arr->right);
-        if(left_result == arr->left && right_result == arr->right) return t;
-        return type_ptr(new type_arr(left_result, right_result));
-    } else if(type_app* app = dynamic_cast<type_app*>(temp.get())) {
-        auto constructor_result = substitute(subst, app->constructor);
-        bool arg_changed = false;
-        std::vector<type_ptr> new_args;
-        for(auto& arg : app->arguments) {
-            auto arg_result = substitute(subst, arg);
-            arg_changed |= arg_result != arg;
-            new_args.push_back(std::move(arg_result));
+    switch(temp->kind) {
+        case TYPE_ARR: {
+            type_arr* arr = static_cast<type_arr*>(temp.get());
+            auto left_result = substitute(subst, arr->left);
+            auto right_result = substitute(subst, arr->right);
+            if(left_result == arr->left && right_result == arr->right) return t;
+            return new_arr(std::move(left_result), std::move(right_result));
         }
-
-        if(constructor_result == app->constructor && !arg_changed) return t;
-        type_app* new_app = new type_app(std::move(constructor_result));
-        std::swap(new_app->arguments, new_args);
-        return type_ptr(new_app);
+        case TYPE_APP: {
+            // The argument vector is only built once something changed.
+            type_app* app = static_cast<type_app*>(temp.get());
+            auto constructor_result = substitute(subst, app->constructor);
+            bool changed = constructor_result != app->constructor;
+            std::vector<type_ptr> arguments;
+            for(size_t i = 0; i < app->arguments.size(); i++) {
+                auto arg_result = substitute(subst, app->arguments[i]);
+                if(!changed && arg_result == app->arguments[i]) continue;
+                if(arguments.empty()) {
+                    arguments.reserve(app->arguments.size());
+                    arguments.assign(app->arguments.begin(), app->arguments.begin() + i);
+                }
+                arguments.push_back(std::move(arg_result));
+                changed = true;
+            }
+            return changed ? new_app(std::move(constructor_result), std::move(arguments)) : t;
+        }
+        default:
+            return t;
     }
-    return t;
 }
 
 bool type_mgr::bind(type_var* s, type_ptr t) {
     // std::cout << "bind s=" << s->name << std::endl;
-    type_var* tvar = dynamic_cast<type_var*>(t.get());
-    if (tvar && tvar->name == s->name) return true;  // No need to bind
+    // s and a variable t come from resolve, so they are representatives of their classes.
+    type_var* tvar = type_cast<type_var>(t.get());
+    int s_root = find(s->id);
+    int t_root = tvar ? find(var_id(t, tvar)) : -1;
+    if (s_root == t_root) return true;  // No need to bind
     if (s->num_type) {
         if (tvar) {
             tvar->set_num_type();  // Pass num_type tag
         } else {
-            type_base* tid = dynamic_cast<type_base*>(t.get());
+            type_base* tid = type_cast<type_base>(t.get());
             if (!tid) return std::cout << "error: Bind num_type to app/arr" << std::endl, false;
             if (tid->name != "Int" && tid->name != "Float")
                 return std::cout << "error: Bind num_type to not Int*/Float*" << std::endl, false;
         }
     }
-    types[s->name] = t;
+    var_entry& s_entry = entry(s_root);
+    if (!tvar) {
+        s_entry.binding = std::move(t);
+        return true;
+    }
+
+    // Union by rank. The merged class still resolves to t, as it did when s pointed at t.
+    var_entry& t_entry = entry(t_root);
+    if (s_entry.rank > t_entry.rank) {
+        t_entry.parent = s_root;
+        s_entry.var = std::move(t);
+    } else {
+        s_entry.parent = t_root;
+        if (s_entry.rank == t_entry.rank) t_entry.rank++;
+    }
     return true;
 }
 
@@ -206,15 +505,27 @@ void type_mgr::find_free(const type_ptr& t,
 
     if(var) {
         into.emplace(var->name, var->num_type);
-    } else if(type_arr* arr = dynamic_cast<type_arr*>(resolved.get())) {
-        ancestors.push_back(t);
-        find_free(arr->left, into, ancestors);
-        find_free(arr->right, into, ancestors);
-        ancestors.pop_back();
-    } else if(type_app* app = dynamic_cast<type_app*>(resolved.get())) {
-        ancestors.push_back(t);
-        find_free(app->constructor, into, ancestors);
-        for(auto& arg : app->arguments) find_free(arg, into, ancestors);
-        ancestors.pop_back();
+        return;
+    }
+
+    switch(resolved->kind) {
+        case TYPE_ARR: {
+            type_arr* arr = static_cast<type_arr*>(resolved.get());
+            ancestors.push_back(t);
+            find_free(arr->left, into, ancestors);
+            find_free(arr->right, into, ancestors);
+            ancestors.pop_back();
+            break;
+        }
+        case TYPE_APP: {
+            type_app* app = static_cast<type_app*>(resolved.get());
+            ancestors.push_back(t);
+            find_free(app->constructor, into, ancestors);
+            for(auto& arg : app->arguments) find_free(arg, into, ancestors);
+            ancestors.pop_back();
+            break;
+        }
+        default:
+            break;
     }
 }
@@ -1,13 +1,30 @@
 #pragma once
+#include <atomic>
 #include <memory>
 #include <map>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <set>
 
 struct type_mgr;
 
+// Which subclass a type is, so the type checker can switch on it instead of using dynamic_cast.
+enum type_kind {
+    TYPE_VAR,
+    TYPE_BASE,
+    TYPE_DATA,
+    TYPE_ARR,
+    TYPE_APP
+};
+
 struct type {
+    const type_kind kind;
+    // Set on the arrows and applications type_mgr shares, see type_mgr::node_table.
+    bool interned = false;
+
+    explicit type(type_kind k) : kind(k) {}
     virtual ~type() = default;
 
     virtual void print(const type_mgr& mgr, std::ostream& to) const = 0;
@@ -15,6 +32,12 @@ struct type {
 
 using type_ptr = std::shared_ptr<type>;
 
+// Like dynamic_cast<T*>, but only compares kinds.
+template <typename T>
+T* type_cast(type* t) {
+    return t && T::has_kind(t->kind) ? static_cast<T*>(t) : nullptr;
+}
+
 struct type_scheme {
     std::vector<std::pair<std::string, bool>> forall;
     type_ptr monotype;
@@ -23,6 +46,24 @@ struct type_scheme {
 
     void print(const type_mgr& mgr, std::ostream& to) const;
     type_ptr instantiate(type_mgr& mgr) const;
+
+    private:
+    // The monotype flattened in post-order, built on the first instantiate. A step
+    // either reuses a subtree without quantified variables, takes the fresh variable
+    // for forall[index], or builds an arrow or application (of index arguments)
+    // from the results of the steps before it.
+    struct instantiate_step {
+        enum { SHARE, FRESH, ARROW, APPLY } op;
+        int index;
+        type_ptr shared;
+    };
+
+    mutable std::vector<instantiate_step> steps;
+    mutable size_t steps_forall = 0;
+    mutable std::mutex steps_mutex;  // schemes are instantiated from several threads by --jobs
+
+    bool build_steps(const type_mgr& mgr, const type_ptr& t,
+            const std::map<std::string, int>& indices) const;
 };
 
 using type_scheme_ptr = std::shared_ptr<type_scheme>;
@@ -30,9 +71,14 @@ using type_scheme_ptr = std::shared_ptr<type_scheme>;
 struct type_var : public type {
     std::string name;
     bool num_type;
+    // Index into type_mgr::vars; -1 until the manager first sees a named variable.
+    // Set only once its entry is filled in, and read by --jobs threads without a lock.
+    std::atomic<int> id{-1};
 
     type_var(std::string n)
-        : name(std::move(n)), num_type(false) {}
+        : type(TYPE_VAR), name(std::move(n)), num_type(false) {}
+
+    static bool has_kind(type_kind k) { return k == TYPE_VAR; }
 
     void set_num_type();
     void print(const type_mgr& mgr, std::ostream& to) const;
@@ -42,8 +88,10 @@ struct type_base : public type {
     std::string name;
     int32_t arity;
 
-    type_base(std::string n, int32_t a = 0) 
-        : name(std::move(n)), arity(a) {}
+    type_base(std::string n, int32_t a = 0, type_kind k = TYPE_BASE)
+        : type(k), name(std::move(n)), arity(a) {}
+
+    static bool has_kind(type_kind k) { return k == TYPE_BASE || k == TYPE_DATA; }
 
     void print(const type_mgr& mgr, std::ostream& to) const;
 };
@@ -56,7 +104,9 @@ struct type_data : public type_base {
     std::map<std::string, constructor> constructors;
 
     type_data(std::string n, int32_t a = 0)
-        : type_base(std::move(n), a) {}
+        : type_base(std::move(n), a, TYPE_DATA) {}
+
+    static bool has_kind(type_kind k) { return k == TYPE_DATA; }
 };
 
 struct type_arr : public type {
@@ -64,7 +114,9 @@ struct type_arr : public type {
     type_ptr right;
 
     type_arr(type_ptr l, type_ptr r)
-        : left(std::move(l)), right(std::move(r)) {}
+        : type(TYPE_ARR), left(std::move(l)), right(std::move(r)) {}
+
+    static bool has_kind(type_kind k) { return k == TYPE_ARR; }
 
     void print(const type_mgr& mgr, std::ostream& to) const;
 };
@@ -74,29 +126,110 @@ struct type_app : public type {
     std::vector<type_ptr> arguments;
 
     type_app(type_ptr c)
-        : constructor(std::move(c)) {}
+        : type(TYPE_APP), constructor(std::move(c)) {}
+
+    static bool has_kind(type_kind k) { return k == TYPE_APP; }
 
     void print(const type_mgr& mgr, std::ostream& to) const;
 };
 
 struct type_mgr {
-    int last_id = 0;
-    std::map<std::string, type_ptr> types;
+    // A union-find node per type variable. Only the entries of roots are kept
+    // up to date: binding is set once the class is bound to a non-variable type,
+    // and var is the variable an unbound class resolves (and prints) as.
+    struct var_entry {
+        int parent;
+        int rank;
+        type_ptr binding;
+        type_ptr var;
+    };
+
+    // The entries of every manager forked from one another. They live in blocks
+    // that never move, and each manager fills a block of its own, so that managers
+    // on different threads can create variables at the same time.
+    struct var_table {
+        static const int block_bits = 13;
+        static const size_t max_blocks = 1 << 13;
+
+        // Reserved up front so that adding a block never moves the others.
+        std::vector<std::unique_ptr<var_entry[]>> blocks;
+        std::mutex blocks_mutex;
+        // Ids of variables created by name rather than by new_type, such as
+        // those in the prelude's type schemes. Equal names are the same variable.
+        std::map<std::string, int> named_vars;
+        std::mutex named_mutex;
+
+        var_table() { blocks.reserve(max_blocks); }
+    };
+
+    // The arrows and applications without type variables, keyed by the addresses of
+    // their children, so that equal ones built by new_arr and new_app are a single
+    // node. Types with variables are not shared: instantiating a scheme makes new
+    // variables, so they would hardly ever be built twice. The nodes live as long as
+    // the managers forked from one another do. The table is split into shards so
+    // that --jobs threads seldom wait on one another.
+    struct node_table {
+        static const size_t shard_count = 64;
+
+        struct key_hash {
+            size_t operator()(const std::pair<const type*, const type*>& key) const;
+            size_t operator()(const std::vector<const type*>& key) const;
+        };
+
+        struct shard {
+            std::mutex mutex;
+            std::unordered_map<std::pair<const type*, const type*>, type_ptr, key_hash> arrows;
+            std::unordered_map<std::vector<const type*>, type_ptr, key_hash> apps;
+        };
+
+        shard shards[shard_count];
+    };
+
+    type_mgr() : table(new var_table), nodes(new node_table) {}
+
+    // A manager for another thread, sharing this one's variables. Managers may
+    // run at once as long as each only unifies variables that no other one can
+    // reach; see type_env::expand.
+    type_mgr fork() const;
 
-    std::string new_type_name();
     type_ptr new_type();
     type_ptr new_num_type();
     type_ptr new_arrow_type();
+    // left -> right, or constructor applied to arguments; the shared node if the
+    // type has no variables. Neither may be changed once built.
+    type_ptr new_arr(type_ptr left, type_ptr right) const;
+    type_ptr new_app(type_ptr constructor, std::vector<type_ptr> arguments = {}) const;
+    // t with every arrow and application without variables in it replaced by its shared node.
+    type_ptr intern(const type_ptr& t) const;
 
     void unify(type_ptr l, type_ptr r);
     type_ptr substitute(
             const std::map<std::string, type_ptr>& subst,
             const type_ptr& t) const;
     type_ptr resolve(type_ptr t, type_var*& var) const;
+    // t with every bound variable replaced by its binding and every other one by
+    // the variable it resolves to, so it can be read without this manager.
+    type_ptr expand(const type_ptr& t) const;
+    // The binding of v's class, or the variable it resolves to; nullptr if v was never seen.
+    type_ptr lookup(const type_var* v) const;
     bool bind(type_var* s, type_ptr t);  // return bind success or not
     void find_free(const type_ptr& t, 
                    std::set<std::pair<std::string, bool>>& into,
                    std::vector<type_ptr> &ancestors) const;
+
+    private:
+    std::shared_ptr<var_table> table;
+    std::shared_ptr<node_table> nodes;
+    // The rest of this manager's current block.
+    mutable int next_id = 0;
+    mutable int block_end = 0;
+
+    static std::string type_name(int id);
+    var_entry& entry(int id) const;
+    int new_id() const;
+    void add_var(int id, type_ptr v) const;
+    int var_id(const type_ptr& t, type_var* v) const;
+    int find(int id) const;
 };
 
 using type_mgr_ptr = std::shared_ptr<type_mgr>;
\ No newline at end of file
@@ -38,12 +38,19 @@ void type_env::generalize(const std::string& name, type_mgr& mgr) {
 
     std::set<std::pair<std::string, bool>> free_variables;
     std::vector<type_ptr> ptr_stack;
+    names_it->second->monotype = mgr.expand(names_it->second->monotype);
     mgr.find_free(names_it->second->monotype, free_variables, ptr_stack);
     for(auto& free : free_variables) {
         names_it->second->forall.push_back(free);
     }
 }
 
+void type_env::expand(const type_mgr& mgr) {
+    for(auto& name : names) {
+        if(name.second->forall.empty()) name.second->monotype = mgr.expand(name.second->monotype);
+    }
+}
+
 type_env_ptr type_scope(type_env_ptr parent) {
     return type_env_ptr(new type_env(std::move(parent)));
 }
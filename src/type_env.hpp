@@ -20,6 +20,10 @@ struct type_env {
     void bind(const std::string& name, type_scheme_ptr t);
     void bind_type(const std::string& type_name, type_ptr t);
     void generalize(const std::string& name, type_mgr& mgr);
+    // Expands the types of the monomorphic bindings. Generalized schemes are expanded
+    // too, so afterwards any thread can instantiate a binding without touching the
+    // variables it was inferred with.
+    void expand(const type_mgr& mgr);
 };
 
 
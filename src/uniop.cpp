@@ -9,11 +9,11 @@ std::string uniop_name(uniop op) {
     return "??";
 }
 
-std::string uniop_action(uniop op) {
+std::string uniop_action(uniop op, num_kind kind) {
     switch(op) {
         case NOT: return "not";
         case BITNOT: return "bitnot";
-        case NEGATE: return "negate";
+        case NEGATE: return "negate" + num_kind_suffix(kind);
     }
     return "??";
 }
\ No newline at end of file
@@ -1,9 +1,10 @@
 #pragma once
 #include <string>
+#include "binop.hpp"
 
 enum uniop {
     NOT, BITNOT, NEGATE
 };
 
 std::string uniop_name(uniop op);
-std::string uniop_action(uniop op);
\ No newline at end of file
+std::string uniop_action(uniop op, num_kind kind = NUM_GENERIC);
\ No newline at end of file